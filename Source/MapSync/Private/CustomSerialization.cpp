@@ -3,14 +3,68 @@
 #include "MapSyncPrivatePCH.h"
 
 #include "Engine/Light.h"
+#include "MapSyncAssetLoader.h"
+#include "MapSyncApplyBatch.h"
+#include "MapSyncProtocol.h"
 
 // Ar.IsLoading() means that we feed binary data into actor (when an actor is loading from disk)
 // When it's false, it's the opposite: the actor is getting serialized into actor (when an actor is being saved to disk)
 
+// Change mask bits, telling which fields follow in a delta
+#define ACTOR_LOCATION_BIT (1 << 0)
+#define ACTOR_ROTATION_BIT (1 << 1)
+#define ACTOR_SCALE_BIT (1 << 2)
+#define SMACTOR_MESH_BIT (1 << 0)
+#define SMACTOR_MATERIALS_BIT (1 << 1)
+#define LIGHT_COLOR_BIT (1 << 0)
+#define LIGHT_INTENSITY_BIT (1 << 1)
+
+// Received assets are loaded asynchronously, and assigned with the rest of the batch once loaded
+static void ApplyStaticMesh(AStaticMeshActor* Actor, const FName& StaticMeshName)
+{
+	TWeakObjectPtr<AStaticMeshActor> WeakActor = Actor;
+	FMapSyncAssetLoader::Get().RequestAsset(StaticMeshName, Actor, TEXT("StaticMesh"), [WeakActor](UObject* Asset)
+	{
+		AStaticMeshActor* Actor = WeakActor.Get();
+		UStaticMesh* FoundMesh = Cast<UStaticMesh>(Asset);
+		if (Actor && FoundMesh)
+		{
+			FMapSyncApplyBatch::Get().SetStaticMesh(Actor, FoundMesh);
+		}
+	});
+}
+
+static void ApplyMaterial(AStaticMeshActor* Actor, int32 Slot, const FName& MaterialName)
+{
+	TWeakObjectPtr<AStaticMeshActor> WeakActor = Actor;
+	FMapSyncAssetLoader::Get().RequestAsset(MaterialName, Actor, FName(TEXT("Material"), Slot), [WeakActor, Slot](UObject* Asset)
+	{
+		AStaticMeshActor* Actor = WeakActor.Get();
+		UMaterial* FoundMat = Cast<UMaterial>(Asset);
+		if (Actor && FoundMat)
+		{
+			FMapSyncApplyBatch::Get().SetMaterial(Actor, Slot, FoundMat);
+		}
+	});
+}
+
 TSubclassOf<UObject> UCustomSerializer::GetSupportedClass() const {	return UObject::StaticClass(); }
 void UCustomSerializer::MapSyncSerialize(FArchive& Ar, UObject* Obj) const
 {
 }
+void UCustomSerializer::MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const
+{
+	MapSyncSerialize(Ar, Obj);
+}
+void UCustomSerializer::MapSyncCapture(FMapSyncCapture& OutCapture, UObject* Obj) const
+{
+	FMapSyncCaptureWriter Ar(OutCapture);
+	MapSyncSerialize(Ar, Obj);
+}
+void UCustomSerializer::MapSyncEncode(FArchive& Ar, const FMapSyncCapture& Capture) const
+{
+	Capture.Encode(Ar);
+}
 
 TSubclassOf<UObject> UCustomSerializerActor::GetSupportedClass() const { return AActor::StaticClass(); }
 void UCustomSerializerActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) const
@@ -29,9 +83,10 @@ void UCustomSerializerActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) const
 		Ar << Rotation;
 		Ar << Scale;
 
-		Actor->SetActorLocation(Location);
-		Actor->SetActorRotation(Rotation);
-		Actor->SetActorScale3D(Scale);
+		// Only the latest received transform is applied, once every frame of the tick was read
+		FMapSyncApplyBatch::Get().SetActorLocation(Actor, Location);
+		FMapSyncApplyBatch::Get().SetActorRotation(Actor, Rotation);
+		FMapSyncApplyBatch::Get().SetActorScale3D(Actor, Scale);
 	}
 	else
 	{
@@ -44,6 +99,63 @@ void UCustomSerializerActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) const
 		Ar << Scale;
 	}
 }
+void UCustomSerializerActor::MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const
+{
+	AActor* Actor = Cast<AActor>(Obj);
+	if (!Actor) return;
+
+	uint8 ChangeMask = 0;
+	FVector Location;
+	FRotator Rotation;
+	FVector Scale;
+
+	// If loading data from binary to actor, only apply the fields that were sent. Only the latest value of each is applied, once every frame of the tick was read
+	if (Ar.IsLoading())
+	{
+		Ar << ChangeMask;
+		if (ChangeMask & ACTOR_LOCATION_BIT)
+		{
+			Ar << Location;
+			FMapSyncApplyBatch::Get().SetActorLocation(Actor, Location);
+		}
+		if (ChangeMask & ACTOR_ROTATION_BIT)
+		{
+			Ar << Rotation;
+			FMapSyncApplyBatch::Get().SetActorRotation(Actor, Rotation);
+		}
+		if (ChangeMask & ACTOR_SCALE_BIT)
+		{
+			Ar << Scale;
+			FMapSyncApplyBatch::Get().SetActorScale3D(Actor, Scale);
+		}
+	}
+	else
+	{
+		Location = Actor->GetActorLocation();
+		Rotation = Actor->GetActorRotation();
+		Scale = Actor->GetActorScale3D();
+
+		ChangeMask = ACTOR_LOCATION_BIT | ACTOR_ROTATION_BIT | ACTOR_SCALE_BIT;
+		if (BaselineAr)
+		{
+			FVector LastLocation;
+			FRotator LastRotation;
+			FVector LastScale;
+			*BaselineAr << LastLocation;
+			*BaselineAr << LastRotation;
+			*BaselineAr << LastScale;
+
+			if (LastLocation == Location) ChangeMask &= ~ACTOR_LOCATION_BIT;
+			if (LastRotation == Rotation) ChangeMask &= ~ACTOR_ROTATION_BIT;
+			if (LastScale == Scale) ChangeMask &= ~ACTOR_SCALE_BIT;
+		}
+
+		Ar << ChangeMask;
+		if (ChangeMask & ACTOR_LOCATION_BIT) Ar << Location;
+		if (ChangeMask & ACTOR_ROTATION_BIT) Ar << Rotation;
+		if (ChangeMask & ACTOR_SCALE_BIT) Ar << Scale;
+	}
+}
 
 TSubclassOf<UObject> UCustomSerializerSMActor::GetSupportedClass() const { return AStaticMeshActor::StaticClass(); }
 void UCustomSerializerSMActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) const
@@ -57,21 +169,14 @@ void UCustomSerializerSMActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) cons
 	// Mesh
 	if (Ar.IsLoading())
 	{
-		FString StaticMeshName;
+		// Asset paths are FNames, so that they are sent once per session through the string table
+		FName StaticMeshName;
 		Ar << StaticMeshName;
-
-		UStaticMesh* FoundMesh = Cast<UStaticMesh>(StaticLoadObject(UStaticMesh::StaticClass(), Cast<AActor>(Obj), *StaticMeshName));
-		if (FoundMesh)
-		{
-			EComponentMobility::Type OldMobility = Cast<AStaticMeshActor>(Obj)->GetStaticMeshComponent()->Mobility;
-			Actor->SetMobility(EComponentMobility::Movable);
-			Actor->GetStaticMeshComponent()->SetStaticMesh(FoundMesh);
-			Actor->SetMobility(OldMobility);
-		}
+		ApplyStaticMesh(Actor, StaticMeshName);
 	}
 	else
 	{
-		FString StaticMeshName = FStringAssetReference(SMComponent->GetStaticMesh()).ToString();
+		FName StaticMeshName = *FStringAssetReference(SMComponent->GetStaticMesh()).ToString();
 		Ar << StaticMeshName;
 	}
 
@@ -83,14 +188,9 @@ void UCustomSerializerSMActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) cons
 
 		for (int32 i = 0; i < MaterialCount; i++)
 		{
-			FString MaterialName;
+			FName MaterialName;
 			Ar << MaterialName;
-
-			UMaterial* FoundMat = Cast<UMaterial>(StaticLoadObject(UMaterial::StaticClass(), Cast<AActor>(Obj), *MaterialName));
-			if (FoundMat)
-			{
-				SMComponent->SetMaterial(i, FoundMat);
-			}
+			ApplyMaterial(Actor, i, MaterialName);
 		}
 	}
 	else
@@ -99,11 +199,100 @@ void UCustomSerializerSMActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) cons
 		Ar << MaterialCount;
 		for (int32 i = 0; i < MaterialCount; i++)
 		{
-			FString MaterialStr = FStringAssetReference(SMComponent->GetMaterial(i)->GetMaterial()).ToString();
+			FName MaterialStr = *FStringAssetReference(SMComponent->GetMaterial(i)->GetMaterial()).ToString();
 			Ar << MaterialStr;
 		}
 	}
 }
+void UCustomSerializerSMActor::MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const
+{
+	auto* Actor = Cast<AStaticMeshActor>(Obj);
+	if (!Actor) return;
+
+	auto* SMComponent = Actor->GetStaticMeshComponent();
+	if (!SMComponent) return;
+
+	// Materials are sent slot by slot: [SLOTCOUNT]([SLOT][MATERIAL])*
+	uint8 ChangeMask = 0;
+	if (Ar.IsLoading())
+	{
+		Ar << ChangeMask;
+		if (ChangeMask & SMACTOR_MESH_BIT)
+		{
+			FName StaticMeshName;
+			Ar << StaticMeshName;
+			ApplyStaticMesh(Actor, StaticMeshName);
+		}
+		if (ChangeMask & SMACTOR_MATERIALS_BIT)
+		{
+			uint32 SlotCount = 0;
+			Ar.SerializeIntPacked(SlotCount);
+			for (uint32 i = 0; i < SlotCount; i++)
+			{
+				uint32 Slot = 0;
+				Ar.SerializeIntPacked(Slot);
+				FName MaterialName;
+				Ar << MaterialName;
+				ApplyMaterial(Actor, Slot, MaterialName);
+			}
+		}
+	}
+	else
+	{
+		FName StaticMeshName = *FStringAssetReference(SMComponent->GetStaticMesh()).ToString();
+		TArray<FName> MaterialNames;
+		for (int32 i = 0; i < SMComponent->GetNumMaterials(); i++)
+		{
+			MaterialNames.Add(*FStringAssetReference(SMComponent->GetMaterial(i)->GetMaterial()).ToString());
+		}
+
+		ChangeMask = SMACTOR_MESH_BIT;
+		TArray<uint32> ChangedSlots;
+		if (BaselineAr)
+		{
+			FName LastStaticMeshName;
+			*BaselineAr << LastStaticMeshName;
+			if (LastStaticMeshName == StaticMeshName) ChangeMask &= ~SMACTOR_MESH_BIT;
+
+			int32 LastMaterialCount;
+			*BaselineAr << LastMaterialCount;
+			for (int32 i = 0; i < LastMaterialCount; i++)
+			{
+				FName LastMaterialName;
+				*BaselineAr << LastMaterialName;
+				if (MaterialNames.IsValidIndex(i) && MaterialNames[i] != LastMaterialName)
+				{
+					ChangedSlots.Add(i);
+				}
+			}
+			for (int32 i = LastMaterialCount; i < MaterialNames.Num(); i++)
+			{
+				ChangedSlots.Add(i);
+			}
+		}
+		else
+		{
+			for (int32 i = 0; i < MaterialNames.Num(); i++)
+			{
+				ChangedSlots.Add(i);
+			}
+		}
+		if (ChangedSlots.Num() > 0) ChangeMask |= SMACTOR_MATERIALS_BIT;
+
+		Ar << ChangeMask;
+		if (ChangeMask & SMACTOR_MESH_BIT) Ar << StaticMeshName;
+		if (ChangeMask & SMACTOR_MATERIALS_BIT)
+		{
+			uint32 SlotCount = ChangedSlots.Num();
+			Ar.SerializeIntPacked(SlotCount);
+			for (uint32 Slot : ChangedSlots)
+			{
+				Ar.SerializeIntPacked(Slot);
+				Ar << MaterialNames[Slot];
+			}
+		}
+	}
+}
 
 TSubclassOf<UObject> UCustomSerializerLightActor::GetSupportedClass() const { return ALight::StaticClass(); }
 void UCustomSerializerLightActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) const
@@ -140,3 +329,51 @@ void UCustomSerializerLightActor::MapSyncSerialize(FArchive& Ar, UObject* Obj) c
 		Ar << Temp;
 	}
 }
+void UCustomSerializerLightActor::MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const
+{
+	auto* Actor = Cast<ALight>(Obj);
+	if (!Actor) return;
+
+	auto* LightComponent = Actor->GetLightComponent();
+	if (!LightComponent) return;
+
+	uint8 ChangeMask = 0;
+	FLinearColor Color;
+	float Intensity;
+
+	if (Ar.IsLoading()) // If Ar into actor
+	{
+		Ar << ChangeMask;
+		if (ChangeMask & LIGHT_COLOR_BIT)
+		{
+			Ar << Color;
+			LightComponent->SetLightColor(Color);
+		}
+		if (ChangeMask & LIGHT_INTENSITY_BIT)
+		{
+			Ar << Intensity;
+			LightComponent->SetIntensity(Intensity);
+		}
+	}
+	else // If actor into Ar
+	{
+		Color = LightComponent->GetLightColor();
+		Intensity = LightComponent->Intensity;
+
+		ChangeMask = LIGHT_COLOR_BIT | LIGHT_INTENSITY_BIT;
+		if (BaselineAr)
+		{
+			FLinearColor LastColor;
+			float LastIntensity;
+			*BaselineAr << LastColor;
+			*BaselineAr << LastIntensity;
+
+			if (LastColor == Color) ChangeMask &= ~LIGHT_COLOR_BIT;
+			if (LastIntensity == Intensity) ChangeMask &= ~LIGHT_INTENSITY_BIT;
+		}
+
+		Ar << ChangeMask;
+		if (ChangeMask & LIGHT_COLOR_BIT) Ar << Color;
+		if (ChangeMask & LIGHT_INTENSITY_BIT) Ar << Intensity;
+	}
+}
@@ -13,6 +13,32 @@
 DEFINE_LOG_CATEGORY(LogMapSync);
 DEFINE_LOG_CATEGORY(LogMapSyncDebug);
 
+DEFINE_STAT(STAT_MapSyncUpdate);
+DEFINE_STAT(STAT_MapSyncReceive);
+DEFINE_STAT(STAT_MapSyncDecode);
+DEFINE_STAT(STAT_MapSyncApply);
+DEFINE_STAT(STAT_MapSyncDetectChanges);
+DEFINE_STAT(STAT_MapSyncSend);
+DEFINE_STAT(STAT_MapSyncResync);
+DEFINE_STAT(STAT_MapSyncSnapshot);
+DEFINE_STAT(STAT_MapSyncCompress);
+DEFINE_STAT(STAT_MapSyncDecompress);
+DEFINE_STAT(STAT_MapSyncBytesIn);
+DEFINE_STAT(STAT_MapSyncBytesOut);
+DEFINE_STAT(STAT_MapSyncFramesIn);
+DEFINE_STAT(STAT_MapSyncFramesOut);
+DEFINE_STAT(STAT_MapSyncCreateCommands);
+DEFINE_STAT(STAT_MapSyncRemoveCommands);
+DEFINE_STAT(STAT_MapSyncUpdateCommands);
+DEFINE_STAT(STAT_MapSyncRenameCommands);
+DEFINE_STAT(STAT_MapSyncActorsSerialized);
+DEFINE_STAT(STAT_MapSyncDirtyActors);
+DEFINE_STAT(STAT_MapSyncReceivedFrames);
+DEFINE_STAT(STAT_MapSyncResyncJobs);
+DEFINE_STAT(STAT_MapSyncQueuedBytes);
+
+FThreadSafeCounter64 FMapSyncPhaseScope::Cycles[(int32)EMapSyncPhase::Count];
+
 void FMapSyncModule::StartupModule()
 {
 	UE_LOG(LogMapSync, Error, TEXT("StartupModule StartupModule StartupModule StartupModule"));
@@ -0,0 +1,108 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncApplyBatch.h"
+#include "MapSyncPrivatePCH.h"
+#include "Runtime/Engine/Classes/Engine/StaticMeshActor.h"
+#include "Runtime/Engine/Classes/Components/StaticMeshComponent.h"
+#include "Runtime/Engine/Public/AI/NavigationSystemBase.h"
+
+FMapSyncApplyBatch& FMapSyncApplyBatch::Get()
+{
+	static FMapSyncApplyBatch Batch;
+	return Batch;
+}
+
+void FMapSyncApplyBatch::SetActorLocation(AActor* Actor, const FVector& Location)
+{
+	PendingChanges.FindOrAdd(Actor).Location = Location;
+}
+
+void FMapSyncApplyBatch::SetActorRotation(AActor* Actor, const FRotator& Rotation)
+{
+	PendingChanges.FindOrAdd(Actor).Rotation = Rotation;
+}
+
+void FMapSyncApplyBatch::SetActorScale3D(AActor* Actor, const FVector& Scale)
+{
+	PendingChanges.FindOrAdd(Actor).Scale = Scale;
+}
+
+void FMapSyncApplyBatch::SetStaticMesh(AStaticMeshActor* Actor, UStaticMesh* StaticMesh)
+{
+	PendingChanges.FindOrAdd(Actor).StaticMesh = StaticMesh;
+}
+
+void FMapSyncApplyBatch::SetMaterial(AStaticMeshActor* Actor, int32 Slot, UMaterialInterface* Material)
+{
+	PendingChanges.FindOrAdd(Actor).Materials.Add(Slot, Material);
+}
+
+void FMapSyncApplyBatch::Flush(UWorld* World, TSet<TWeakObjectPtr<AActor>>& OutAppliedActors)
+{
+	if (PendingChanges.Num() == 0)
+	{
+		return;
+	}
+
+	// Navigation is updated once the whole batch is applied, instead of for every actor
+	FNavigationLockContext NavigationLock(World, ENavigationLockReason::Unknown);
+
+	for (const TPair<TWeakObjectPtr<AActor>, FPendingChanges>& Pending : PendingChanges)
+	{
+		// Removed since
+		AActor* Actor = Pending.Key.Get();
+		if (!Actor || Actor->IsPendingKill())
+		{
+			continue;
+		}
+		const FPendingChanges& Changes = Pending.Value;
+
+		// Mesh and materials together, so that the render state is only rebuilt once with both
+		AStaticMeshActor* SMActor = Cast<AStaticMeshActor>(Actor);
+		UStaticMeshComponent* SMComponent = SMActor ? SMActor->GetStaticMeshComponent() : nullptr;
+		if (SMComponent)
+		{
+			if (UStaticMesh* StaticMesh = Changes.StaticMesh.Get())
+			{
+				EComponentMobility::Type OldMobility = SMComponent->Mobility;
+				SMActor->SetMobility(EComponentMobility::Movable);
+				SMComponent->SetStaticMesh(StaticMesh);
+				SMActor->SetMobility(OldMobility);
+			}
+			for (const TPair<int32, TWeakObjectPtr<UMaterialInterface>>& Material : Changes.Materials)
+			{
+				if (Material.Value.IsValid())
+				{
+					SMComponent->SetMaterial(Material.Key, Material.Value.Get());
+				}
+			}
+		}
+
+		// The whole transform at once, so that it's propagated to the components once
+		if (Changes.Location.IsSet() || Changes.Rotation.IsSet() || Changes.Scale.IsSet())
+		{
+			FTransform Transform = Actor->GetActorTransform();
+			if (Changes.Location.IsSet())
+			{
+				Transform.SetLocation(Changes.Location.GetValue());
+			}
+			if (Changes.Rotation.IsSet())
+			{
+				Transform.SetRotation(Changes.Rotation.GetValue().Quaternion());
+			}
+			if (Changes.Scale.IsSet())
+			{
+				Transform.SetScale3D(Changes.Scale.GetValue());
+			}
+			Actor->SetActorTransform(Transform, false, nullptr, ETeleportType::TeleportPhysics);
+		}
+
+		OutAppliedActors.Add(Actor);
+	}
+	PendingChanges.Empty();
+}
+
+void FMapSyncApplyBatch::Discard()
+{
+	PendingChanges.Empty();
+}
@@ -0,0 +1,115 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncAssetLoader.h"
+#include "MapSyncPrivatePCH.h"
+#include "Runtime/Engine/Classes/Engine/AssetManager.h"
+#include "Runtime/Engine/Classes/Engine/StreamableManager.h"
+
+FMapSyncAssetLoader& FMapSyncAssetLoader::Get()
+{
+	static FMapSyncAssetLoader Loader;
+	return Loader;
+}
+
+void FMapSyncAssetLoader::RequestAsset(const FName& AssetPath, UObject* Target, const FName& Slot, FOnAssetLoaded&& OnLoaded)
+{
+	TPair<TWeakObjectPtr<UObject>, FName> Key(Target, Slot);
+
+	// Already loaded, no need to wait. This also supersedes a pending load for the same slot
+	UObject* Asset = FindLoadedAsset(AssetPath);
+	if (Asset || AssetPath == NAME_None)
+	{
+		PendingAssignments.Remove(Key);
+		if (Asset)
+		{
+			OnLoaded(Asset);
+		}
+		return;
+	}
+
+	// Without an asset manager, there's nothing to load asynchronously with
+	if (!UAssetManager::IsValid())
+	{
+		PendingAssignments.Remove(Key);
+		Asset = StaticLoadObject(UObject::StaticClass(), nullptr, *AssetPath.ToString());
+		if (Asset)
+		{
+			ResolvedAssets.Add(AssetPath, Asset);
+			OnLoaded(Asset);
+		}
+		return;
+	}
+
+	FPendingAssignment& Assignment = PendingAssignments.Add(Key);
+	Assignment.AssetPath = AssetPath;
+	Assignment.Target = Target;
+	Assignment.OnLoaded = MoveTemp(OnLoaded);
+	if (!BatchNames.Contains(AssetPath))
+	{
+		BatchNames.Add(AssetPath);
+		BatchPaths.Add(FSoftObjectPath(AssetPath.ToString()));
+	}
+}
+
+void FMapSyncAssetLoader::FlushRequests()
+{
+	if (BatchPaths.Num() == 0)
+	{
+		return;
+	}
+
+	const int32 HandleId = NextHandleId++;
+	FStreamableDelegate OnLoaded = FStreamableDelegate::CreateRaw(this, &FMapSyncAssetLoader::OnBatchLoaded, BatchNames, HandleId);
+	TSharedPtr<FStreamableHandle> Handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(BatchPaths, OnLoaded);
+	BatchPaths.Reset();
+	BatchNames.Reset();
+
+	// The delegate may already have been called, if everything was loaded meanwhile
+	if (Handle.IsValid() && !Handle->HasLoadCompleted())
+	{
+		ActiveHandles.Add(HandleId, Handle);
+	}
+}
+
+UObject* FMapSyncAssetLoader::FindLoadedAsset(const FName& AssetPath)
+{
+	if (TWeakObjectPtr<UObject>* ResolvedAsset = ResolvedAssets.Find(AssetPath))
+	{
+		if (UObject* Asset = ResolvedAsset->Get())
+		{
+			return Asset;
+		}
+	}
+
+	UObject* Asset = FSoftObjectPath(AssetPath.ToString()).ResolveObject();
+	if (Asset)
+	{
+		ResolvedAssets.Add(AssetPath, Asset);
+	}
+	return Asset;
+}
+
+void FMapSyncAssetLoader::OnBatchLoaded(TArray<FName> AssetPaths, int32 HandleId)
+{
+	ActiveHandles.Remove(HandleId);
+
+	for (auto It = PendingAssignments.CreateIterator(); It; ++It)
+	{
+		FPendingAssignment& Assignment = It.Value();
+		if (!AssetPaths.Contains(Assignment.AssetPath))
+		{
+			continue;
+		}
+
+		UObject* Asset = FindLoadedAsset(Assignment.AssetPath);
+		if (!Asset)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to load asset %s"), *Assignment.AssetPath.ToString());
+		}
+		else if (Assignment.Target.IsValid())
+		{
+			Assignment.OnLoaded(Asset);
+		}
+		It.RemoveCurrent();
+	}
+}
@@ -0,0 +1,331 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncBenchmarkCommandlet.h"
+#include "MapSyncPrivatePCH.h"
+#include "MapSyncBenchmarkHelpers.h"
+#include "Runtime/Engine/Classes/Engine/StaticMeshActor.h"
+#include "Runtime/Engine/Classes/Engine/PointLight.h"
+#include "Runtime/Engine/Classes/Engine/StaticMesh.h"
+#include "Runtime/Core/Public/Misc/FileHelper.h"
+#include "Runtime/Engine/Classes/Engine/Blueprint.h"
+#include "Runtime/Engine/Classes/Engine/BlueprintGeneratedClass.h"
+#include "Editor/UnrealEd/Public/Kismet2/KismetEditorUtilities.h"
+#include "Runtime/CoreUObject/Public/Misc/PackageName.h"
+
+#define BENCHMARK_DEFAULT_ACTORS TEXT("1000,10000,100000")
+#define BENCHMARK_DEFAULT_CLIENTS 4
+#define BENCHMARK_DEFAULT_ITERATIONS 10
+#define BENCHMARK_BLUEPRINT_PACKAGE TEXT("/Temp/MapSyncBenchmark/BP_MapSyncBenchmark") // Of the blueprint created when none is given
+
+namespace
+{
+	struct FBenchmarkResult
+	{
+		int32 ActorCount = 0;
+		FString Workload;
+		int32 Iterations = 0;
+		FMapSyncBenchmarkTicks Ticks;
+		TArray<double> Latencies; // From the change to a client receiving it, in seconds
+		int64 WireBytes = 0; // Sent and received by the clients
+	};
+
+	int64 GetWireBytes(const TArray<FMapSyncBenchmarkClient>& Clients)
+	{
+		int64 Bytes = 0;
+		for (const FMapSyncBenchmarkClient& Client : Clients)
+		{
+			Bytes += Client.GetWireBytes();
+		}
+		return Bytes;
+	}
+
+	// Ticks the server and the clients until IsDone returns true. Returns false if it took too long
+	bool TickUntil(FMapSyncBenchmarkServer& Server, TArray<FMapSyncBenchmarkClient>& Clients, FBenchmarkResult& Result, TFunctionRef<bool()> IsDone)
+	{
+		const bool bDone = Server.TickUntil(Result.Ticks, BENCHMARK_STEP_TIMEOUT, 0.f, [&]()
+		{
+			for (FMapSyncBenchmarkClient& Client : Clients)
+			{
+				Client.Pump();
+			}
+		}, IsDone);
+		if (!bDone)
+		{
+			UE_LOG(LogMapSync, Error, TEXT("Benchmark workload %s timed out"), *Result.Workload);
+		}
+		return bDone;
+	}
+
+	// Waits for every client, but the ones skipped, to receive an update, and counts how long it took
+	bool TickUntilUpdated(FMapSyncBenchmarkServer& Server, TArray<FMapSyncBenchmarkClient>& Clients, FBenchmarkResult& Result, double StartTime, int32 SkippedClientIdx = INDEX_NONE)
+	{
+		const bool bDone = TickUntil(Server, Clients, Result, [&]()
+		{
+			for (int32 ClientIdx = 0; ClientIdx < Clients.Num(); ClientIdx++)
+			{
+				if (ClientIdx != SkippedClientIdx && Clients[ClientIdx].UpdateTimes.Num() == 0)
+				{
+					return false;
+				}
+			}
+			return SkippedClientIdx == INDEX_NONE || Clients[SkippedClientIdx].SequenceTimes.Num() > 0;
+		});
+
+		for (int32 ClientIdx = 0; ClientIdx < Clients.Num(); ClientIdx++)
+		{
+			if (ClientIdx != SkippedClientIdx && Clients[ClientIdx].UpdateTimes.Num() > 0)
+			{
+				Result.Latencies.Add(Clients[ClientIdx].UpdateTimes[0] - StartTime);
+			}
+		}
+		return bDone;
+	}
+
+	// Mostly meshes, like most levels, with some lights, and blueprints if one was given
+	UClass* GetBenchmarkActorClass(int32 Idx, UClass* BlueprintClass)
+	{
+		if (BlueprintClass && Idx % 20 == 0)
+		{
+			return BlueprintClass;
+		}
+		return Idx % 10 == 1 ? APointLight::StaticClass() : AStaticMeshActor::StaticClass();
+	}
+
+	// A blueprint of static mesh actor, so that the levels have blueprint actors without any project asset. Rooted until the benchmark is done
+	UBlueprint* CreateBenchmarkBlueprint()
+	{
+		UPackage* Package = CreatePackage(nullptr, BENCHMARK_BLUEPRINT_PACKAGE);
+		Package->SetFlags(RF_Transient);
+		UBlueprint* Blueprint = FKismetEditorUtilities::CreateBlueprint(AStaticMeshActor::StaticClass(), Package, *FPackageName::GetShortName(BENCHMARK_BLUEPRINT_PACKAGE), BPTYPE_Normal, UBlueprint::StaticClass(), UBlueprintGeneratedClass::StaticClass());
+		if (Blueprint)
+		{
+			Blueprint->AddToRoot();
+		}
+		return Blueprint;
+	}
+
+	FBenchmarkResult& AddResult(TArray<FBenchmarkResult>& Results, int32 ActorCount, const TCHAR* Workload, int32 Iterations)
+	{
+		FBenchmarkResult& Result = Results[Results.AddDefaulted()];
+		Result.ActorCount = ActorCount;
+		Result.Workload = Workload;
+		Result.Iterations = Iterations;
+		Result.Ticks.SampleBaselineMemory();
+		return Result;
+	}
+
+	bool RunLevel(int32 ActorCount, int32 ClientCount, int32 Iterations, int32 Port, UStaticMesh* Mesh, UClass* BlueprintClass, TArray<FBenchmarkResult>& OutResults)
+	{
+		UE_LOG(LogMapSync, Display, TEXT("Benchmarking a level of %d actors with %d clients"), ActorCount, ClientCount);
+
+		UWorld* World = GEditor->NewMap();
+		if (!World)
+		{
+			UE_LOG(LogMapSync, Error, TEXT("Unable to create the benchmark level"));
+			return false;
+		}
+
+		TArray<AActor*> Actors;
+		for (int32 ActorIdx = 0; ActorIdx < ActorCount; ActorIdx++)
+		{
+			if (AActor* Actor = FMapSyncBenchmarkUtils::SpawnBenchmarkActor(World, GetBenchmarkActorClass(ActorIdx, BlueprintClass), ActorIdx, Mesh))
+			{
+				Actors.Add(Actor);
+			}
+		}
+
+		FMapSyncBenchmarkServer Server;
+		if (!Server.Start(Port))
+		{
+			return false;
+		}
+
+		bool bSuccess = true;
+		TArray<FMapSyncBenchmarkClient> Clients;
+		Clients.SetNum(ClientCount);
+		Clients[0].bKeepLastUpdate = true;
+
+		// Every client joins at once, and is streamed the whole level
+		{
+			FBenchmarkResult& Result = AddResult(OutResults, ActorCount, TEXT("Resync"), 1);
+			const double StartTime = FPlatformTime::Seconds();
+			for (FMapSyncBenchmarkClient& Client : Clients)
+			{
+				bSuccess &= Client.Connect(Port);
+			}
+			bSuccess = bSuccess && TickUntil(Server, Clients, Result, [&]()
+			{
+				return !Clients.ContainsByPredicate([](const FMapSyncBenchmarkClient& Client) { return !Client.bResynced; });
+			});
+			for (const FMapSyncBenchmarkClient& Client : Clients)
+			{
+				if (Client.bResynced)
+				{
+					Result.Latencies.Add(Client.ResyncedTime - StartTime);
+				}
+			}
+			Result.WireBytes = GetWireBytes(Clients);
+		}
+
+		// Every actor moved at once, the way a big selection is
+		if (bSuccess)
+		{
+			FBenchmarkResult& Result = AddResult(OutResults, ActorCount, TEXT("Move"), Iterations);
+			const int64 BytesBefore = GetWireBytes(Clients);
+			for (int32 Iteration = 0; Iteration < Iterations && bSuccess; Iteration++)
+			{
+				for (FMapSyncBenchmarkClient& Client : Clients)
+				{
+					Client.ResetUpdates();
+				}
+				for (AActor* Actor : Actors)
+				{
+					Actor->SetActorLocation(Actor->GetActorLocation() + FVector(0.f, 0.f, 10.f));
+					Actor->PostEditMove(true);
+				}
+				bSuccess = TickUntilUpdated(Server, Clients, Result, FPlatformTime::Seconds());
+			}
+			Result.WireBytes = GetWireBytes(Clients) - BytesBefore;
+		}
+
+		// A client sends the last move back: the server applies it, then forwards it to the others. Values don't change, but it goes through the whole apply path
+		if (bSuccess && Clients[0].LastUpdate.Num() > 0)
+		{
+			FBenchmarkResult& Result = AddResult(OutResults, ActorCount, TEXT("Echo"), 1);
+			const int64 BytesBefore = GetWireBytes(Clients);
+			for (FMapSyncBenchmarkClient& Client : Clients)
+			{
+				Client.ResetUpdates();
+			}
+			const double StartTime = FPlatformTime::Seconds();
+			Clients[0].SendLastUpdate();
+			bSuccess = TickUntilUpdated(Server, Clients, Result, StartTime, 0);
+			Result.WireBytes = GetWireBytes(Clients) - BytesBefore;
+		}
+
+		// A tenth of the level pasted, then deleted
+		TArray<AActor*> PastedActors;
+		if (bSuccess)
+		{
+			FBenchmarkResult& Result = AddResult(OutResults, ActorCount, TEXT("Paste"), 1);
+			const int64 BytesBefore = GetWireBytes(Clients);
+			for (FMapSyncBenchmarkClient& Client : Clients)
+			{
+				Client.ResetUpdates();
+			}
+			for (int32 ActorIdx = ActorCount; ActorIdx < ActorCount + FMath::Max(1, ActorCount / 10); ActorIdx++)
+			{
+				if (AActor* Actor = FMapSyncBenchmarkUtils::SpawnBenchmarkActor(World, GetBenchmarkActorClass(ActorIdx, BlueprintClass), ActorIdx, Mesh))
+				{
+					PastedActors.Add(Actor);
+				}
+			}
+			bSuccess = TickUntilUpdated(Server, Clients, Result, FPlatformTime::Seconds());
+			Result.WireBytes = GetWireBytes(Clients) - BytesBefore;
+		}
+
+		if (bSuccess)
+		{
+			FBenchmarkResult& Result = AddResult(OutResults, ActorCount, TEXT("Delete"), 1);
+			const int64 BytesBefore = GetWireBytes(Clients);
+			for (FMapSyncBenchmarkClient& Client : Clients)
+			{
+				Client.ResetUpdates();
+			}
+			for (AActor* Actor : PastedActors)
+			{
+				World->EditorDestroyActor(Actor, true);
+			}
+			bSuccess = TickUntilUpdated(Server, Clients, Result, FPlatformTime::Seconds());
+			Result.WireBytes = GetWireBytes(Clients) - BytesBefore;
+		}
+
+		Server.Stop([&]() { Clients.Empty(); });
+		return bSuccess;
+	}
+}
+
+UMapSyncBenchmarkCommandlet::UMapSyncBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMapSyncBenchmarkCommandlet::Main(const FString& Params)
+{
+	if (!GEditor)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("The MapSync benchmark must run in the editor"));
+		return 1;
+	}
+
+	FString ActorCountsStr = BENCHMARK_DEFAULT_ACTORS;
+	int32 ClientCount = BENCHMARK_DEFAULT_CLIENTS;
+	int32 Iterations = BENCHMARK_DEFAULT_ITERATIONS;
+	int32 Port = BENCHMARK_DEFAULT_PORT;
+	FString BlueprintPath;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("MapSync") / TEXT("Benchmark.csv");
+	FParse::Value(*Params, TEXT("Actors="), ActorCountsStr, false);
+	FParse::Value(*Params, TEXT("Clients="), ClientCount);
+	FParse::Value(*Params, TEXT("Iterations="), Iterations);
+	FParse::Value(*Params, TEXT("Port="), Port);
+	FParse::Value(*Params, TEXT("Blueprint="), BlueprintPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	ClientCount = FMath::Max(ClientCount, 1);
+	Iterations = FMath::Max(Iterations, 1);
+
+	UStaticMesh* Mesh = LoadObject<UStaticMesh>(nullptr, BENCHMARK_MESH_PATH);
+	UClass* BlueprintClass = nullptr;
+	UBlueprint* DefaultBlueprint = nullptr;
+	if (!BlueprintPath.IsEmpty())
+	{
+		BlueprintClass = LoadObject<UClass>(nullptr, *BlueprintPath);
+		if (!BlueprintClass)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to load blueprint class %s, the benchmark levels won't have any blueprint actor"), *BlueprintPath);
+		}
+	}
+	else
+	{
+		DefaultBlueprint = CreateBenchmarkBlueprint();
+		BlueprintClass = DefaultBlueprint ? *DefaultBlueprint->GeneratedClass : nullptr;
+		if (!BlueprintClass)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to create the benchmark blueprint, the benchmark levels won't have any blueprint actor"));
+		}
+	}
+
+	bool bSuccess = true;
+	TArray<FBenchmarkResult> Results;
+	TArray<FString> ActorCountStrs;
+	ActorCountsStr.ParseIntoArray(ActorCountStrs, TEXT(","));
+	for (const FString& ActorCountStr : ActorCountStrs)
+	{
+		bSuccess &= RunLevel(FCString::Atoi(*ActorCountStr), ClientCount, Iterations, Port, Mesh, BlueprintClass, Results);
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	}
+	if (DefaultBlueprint)
+	{
+		DefaultBlueprint->RemoveFromRoot();
+	}
+
+	FString Csv = TEXT("Actors,Clients,Workload,Iterations,Ticks,TickTotalMs,TickMaxMs,SerializeMs,ApplyMs,WireBytes,LatencyP50Ms,LatencyP90Ms,LatencyP99Ms,PeakMemoryDeltaMiB\n");
+	for (const FBenchmarkResult& Result : Results)
+	{
+		Csv += FString::Printf(TEXT("%d,%d,%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%lld,%.3f,%.3f,%.3f,%.1f\n"),
+			Result.ActorCount, ClientCount, *Result.Workload, Result.Iterations, Result.Ticks.Count, Result.Ticks.TotalTime * 1000.0, Result.Ticks.MaxTime * 1000.0,
+			Result.Ticks.SerializeTime * 1000.0, Result.Ticks.ApplyTime * 1000.0, Result.WireBytes,
+			FMapSyncBenchmarkUtils::GetPercentile(Result.Latencies, 0.5f) * 1000.0, FMapSyncBenchmarkUtils::GetPercentile(Result.Latencies, 0.9f) * 1000.0, FMapSyncBenchmarkUtils::GetPercentile(Result.Latencies, 0.99f) * 1000.0,
+			Result.Ticks.GetPeakMemoryDelta() / (1024.0 * 1024.0));
+	}
+
+	if (!FFileHelper::SaveStringToFile(Csv, *OutputPath))
+	{
+		UE_LOG(LogMapSync, Error, TEXT("Unable to write the benchmark results to %s"), *OutputPath);
+		return 1;
+	}
+	UE_LOG(LogMapSync, Display, TEXT("MapSync benchmark results written to %s"), *OutputPath);
+	return bSuccess ? 0 : 1;
+}
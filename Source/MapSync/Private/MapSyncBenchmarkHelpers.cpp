@@ -0,0 +1,197 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncBenchmarkHelpers.h"
+#include "MapSyncPrivatePCH.h"
+#include "MapSyncEdMode.h"
+#include "Editor/UnrealEd/Public/EditorModeRegistry.h"
+#include "Editor/UnrealEd/Public/EditorModeManager.h"
+#include "Runtime/Engine/Classes/Engine/StaticMeshActor.h"
+#include "Runtime/Engine/Classes/Components/StaticMeshComponent.h"
+
+bool FMapSyncBenchmarkClient::Connect(int32 Port)
+{
+	Network = FMapSyncNetworkWorker::Connect(FIPv4Endpoint(FIPv4Address(127, 0, 0, 1), Port));
+	return Network.IsValid();
+}
+
+void FMapSyncBenchmarkClient::ResetUpdates()
+{
+	UpdateTimes.Reset();
+	SequenceTimes.Reset();
+}
+
+int64 FMapSyncBenchmarkClient::GetWireBytes() const
+{
+	return Stats.IsValid() ? Stats->BytesReceived.GetValue() + Stats->BytesSent.GetValue() : 0;
+}
+
+void FMapSyncBenchmarkClient::SendLastUpdate()
+{
+	TArray<uint8> SerializedData;
+	SerializedData.Add(UPDATE_HEADER);
+	SerializedData.Append(LastUpdate);
+	Network->Send(FMapSyncEdMode::ServerPeerId, MoveTemp(SerializedData));
+}
+
+void FMapSyncBenchmarkClient::Pump()
+{
+	FMapSyncNetInbound Inbound;
+	while (Network.IsValid() && Network->Dequeue(Inbound))
+	{
+		if (Inbound.Event == EMapSyncNetEvent::Connected)
+		{
+			Stats = Inbound.Stats;
+			continue;
+		}
+		if (Inbound.Event == EMapSyncNetEvent::Disconnected)
+		{
+			continue;
+		}
+
+		FMemoryReader Ar(Inbound.Payload);
+		char Header;
+		Ar << Header;
+		if (Header == WELCOME_HEADER)
+		{
+			OnWelcome(Ar);
+		}
+		else if (Header == UPDATE_HEADER)
+		{
+			UpdateTimes.Add(FPlatformTime::Seconds());
+			if (bKeepLastUpdate)
+			{
+				uint32 Seq = 0;
+				Ar.SerializeIntPacked(Seq);
+				LastUpdate.Reset();
+				LastUpdate.Append(Inbound.Payload.GetData() + Ar.Tell(), Inbound.Payload.Num() - Ar.Tell());
+			}
+		}
+		else if (Header == SEQUENCE_HEADER)
+		{
+			SequenceTimes.Add(FPlatformTime::Seconds());
+		}
+		else if (Header == RESYNCEND_HEADER)
+		{
+			bResynced = true;
+			ResyncedTime = FPlatformTime::Seconds();
+		}
+	}
+}
+
+void FMapSyncBenchmarkClient::OnWelcome(FMemoryReader& Ar)
+{
+	int32 ProtocolVersion = 0;
+	uint32 SenderId = 0;
+	FGuid ServerSessionGuid;
+	FString ServerCompressionFormat;
+	int32 ServerCompressionFlags = COMPRESS_NoFlags;
+	Ar << ProtocolVersion;
+	Ar << SenderId;
+	Ar << ServerSessionGuid;
+	Ar << ServerCompressionFormat;
+	Ar << ServerCompressionFlags;
+
+	FMapSyncCompressionSettings Compression;
+	if (FMapSyncNetworkWorker::IsCompressionFormatSupported(*ServerCompressionFormat))
+	{
+		Compression.Format = *ServerCompressionFormat;
+		Compression.Flags = (ECompressionFlags)ServerCompressionFlags;
+		Compression.Threshold = COMPRESSION_DEFAULT_THRESHOLD;
+	}
+
+	TArray<uint8> SerializedData;
+	FMemoryWriter HelloAr(SerializedData, true);
+	char Header = HELLO_HEADER;
+	HelloAr << Header;
+	HelloAr << ProtocolVersion;
+	FString CompressionFormat = Compression.Format.ToString();
+	HelloAr << CompressionFormat;
+	FGuid NoSession;
+	HelloAr << NoSession;
+	uint32 Seq = 0;
+	HelloAr.SerializeIntPacked(Seq);
+	Network->Send(FMapSyncEdMode::ServerPeerId, MoveTemp(SerializedData));
+	Network->SetCompression(FMapSyncEdMode::ServerPeerId, Compression);
+	bWelcomed = true;
+}
+
+void FMapSyncBenchmarkTicks::SampleBaselineMemory()
+{
+	BaselineMemory = FPlatformMemory::GetStats().UsedPhysical;
+	PeakMemory = BaselineMemory;
+}
+
+bool FMapSyncBenchmarkServer::Start(int32 Port)
+{
+	EdMode = FEditorModeRegistry::Get().CreateMode(FMapSyncEdMode::EM_MapSyncEdModeId, GLevelEditorModeTools());
+	Mode = static_cast<FMapSyncEdMode*>(EdMode.Get());
+	if (!Mode)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("MapSync editor mode isn't registered"));
+		return false;
+	}
+	Mode->BindToPort(Port, false);
+	return Mode->bBound;
+}
+
+bool FMapSyncBenchmarkServer::TickUntil(FMapSyncBenchmarkTicks& Ticks, double Timeout, float SleepTime, TFunctionRef<void()> PumpClients, TFunctionRef<bool()> IsDone)
+{
+	const double TimeoutTime = FPlatformTime::Seconds() + Timeout;
+	while (true)
+	{
+		PumpClients();
+		if (IsDone())
+		{
+			return true;
+		}
+		if (FPlatformTime::Seconds() > TimeoutTime)
+		{
+			return false;
+		}
+
+		const int64 SerializeCycles = FMapSyncPhaseScope::GetCycles(EMapSyncPhase::DetectChanges);
+		const int64 ApplyCycles = FMapSyncPhaseScope::GetCycles(EMapSyncPhase::Decode) + FMapSyncPhaseScope::GetCycles(EMapSyncPhase::Apply);
+		const double StartTime = FPlatformTime::Seconds();
+		Mode->UpdateMapSync();
+		const double TickTime = FPlatformTime::Seconds() - StartTime;
+		Ticks.Count++;
+		Ticks.TotalTime += TickTime;
+		Ticks.MaxTime = FMath::Max(Ticks.MaxTime, TickTime);
+		Ticks.SerializeTime += (FMapSyncPhaseScope::GetCycles(EMapSyncPhase::DetectChanges) - SerializeCycles) * FPlatformTime::GetSecondsPerCycle64();
+		Ticks.ApplyTime += (FMapSyncPhaseScope::GetCycles(EMapSyncPhase::Decode) + FMapSyncPhaseScope::GetCycles(EMapSyncPhase::Apply) - ApplyCycles) * FPlatformTime::GetSecondsPerCycle64();
+		Ticks.PeakMemory = FMath::Max<uint64>(Ticks.PeakMemory, FPlatformMemory::GetStats().UsedPhysical);
+		FPlatformProcess::Sleep(SleepTime);
+	}
+}
+
+void FMapSyncBenchmarkServer::Stop(TFunctionRef<void()> ReleaseClients)
+{
+	if (Mode)
+	{
+		Mode->Cancel();
+	}
+	ReleaseClients();
+	EdMode.Reset();
+	Mode = nullptr;
+}
+
+AActor* FMapSyncBenchmarkUtils::SpawnBenchmarkActor(UWorld* World, UClass* Class, int32 Idx, UStaticMesh* Mesh)
+{
+	const FVector Location((Idx % 100) * 200.f, ((Idx / 100) % 100) * 200.f, (Idx / 10000) * 200.f);
+	AActor* Actor = World->SpawnActor<AActor>(Class, Location, FRotator::ZeroRotator);
+	if (AStaticMeshActor* StaticMeshActor = Cast<AStaticMeshActor>(Actor))
+	{
+		StaticMeshActor->GetStaticMeshComponent()->SetStaticMesh(Mesh);
+	}
+	return Actor;
+}
+
+double FMapSyncBenchmarkUtils::GetPercentile(TArray<double> Values, float Percentile)
+{
+	if (Values.Num() == 0)
+	{
+		return 0.0;
+	}
+	Values.Sort();
+	return Values[FMath::Clamp(FMath::CeilToInt(Percentile * Values.Num()) - 1, 0, Values.Num() - 1)];
+}
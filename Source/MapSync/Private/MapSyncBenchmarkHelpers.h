@@ -0,0 +1,83 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "MapSyncNetwork.h"
+
+#define BENCHMARK_DEFAULT_PORT 8990
+#define BENCHMARK_STEP_TIMEOUT 300.0 // A benchmark step not done after this many seconds fails the benchmark
+#define BENCHMARK_MESH_PATH TEXT("/Engine/BasicShapes/Cube.Cube")
+
+class FEdMode;
+class FMapSyncEdMode;
+class FMemoryReader;
+class UStaticMesh;
+
+// A loopback client, only reading what it needs to follow the session
+struct FMapSyncBenchmarkClient
+{
+	TUniquePtr<FMapSyncNetworkWorker> Network;
+	FMapSyncPeerStatsPtr Stats;
+	bool bResynced = false;
+	double ResyncedTime = 0.0;
+	TArray<double> UpdateTimes; // When every update frame was received, since ResetUpdates
+	TArray<double> SequenceTimes; // When every sequence frame was received since ResetUpdates, i.e. updates of ours the server applied
+	bool bWelcomed = false;
+	bool bKeepLastUpdate = false;
+	TArray<uint8> LastUpdate; // Without its header and number, so that it can be sent back as is
+
+	bool Connect(int32 Port);
+	void ResetUpdates();
+	int64 GetWireBytes() const;
+	void SendLastUpdate();
+	void Pump();
+
+private:
+	// Says hello, accepting the server's compression like an editor would. Strings aren't needed, frames are never decoded
+	void OnWelcome(FMemoryReader& Ar);
+};
+
+// What ticking the server cost
+struct FMapSyncBenchmarkTicks
+{
+	int32 Count = 0;
+	double TotalTime = 0.0; // In seconds
+	double MaxTime = 0.0;
+	double SerializeTime = 0.0; // Part of TotalTime spent detecting and serializing local changes
+	double ApplyTime = 0.0; // Part of TotalTime spent decoding and applying received updates
+	uint64 BaselineMemory = 0; // Used physical memory before the ticks, see SampleBaselineMemory
+	uint64 PeakMemory = 0; // Highest used physical memory after a tick
+
+	// To be called before what the ticks measure starts, so that what happens before doesn't count
+	void SampleBaselineMemory();
+	uint64 GetPeakMemoryDelta() const { return PeakMemory > BaselineMemory ? PeakMemory - BaselineMemory : 0; }
+};
+
+// The real editor mode, only without its toolkit, ticked by hand
+class FMapSyncBenchmarkServer
+{
+public:
+	// Creates the mode and binds it, without ever recording the session. Returns false if it couldn't
+	bool Start(int32 Port);
+
+	// Ticks the server, pumping the clients before every check, until IsDone returns true. Returns false if it took longer than Timeout, in seconds
+	bool TickUntil(FMapSyncBenchmarkTicks& Ticks, double Timeout, float SleepTime, TFunctionRef<void()> PumpClients, TFunctionRef<bool()> IsDone);
+
+	// Clients go away after the server, so that they get its exit message
+	void Stop(TFunctionRef<void()> ReleaseClients);
+
+	FMapSyncEdMode& GetMode() const { return *Mode; }
+
+private:
+	TSharedPtr<FEdMode> EdMode;
+	FMapSyncEdMode* Mode = nullptr;
+};
+
+struct FMapSyncBenchmarkUtils
+{
+	// Spawns the Idx-th actor of a benchmark level, on a grid. Static mesh actors get Mesh
+	static AActor* SpawnBenchmarkActor(UWorld* World, UClass* Class, int32 Idx, UStaticMesh* Mesh);
+
+	// Percentile is between 0 and 1. Returns 0 without any value
+	static double GetPercentile(TArray<double> Values, float Percentile);
+};
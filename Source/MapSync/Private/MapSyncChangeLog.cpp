@@ -0,0 +1,170 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncChangeLog.h"
+#include "MapSyncPrivatePCH.h"
+#include "Runtime/Core/Public/HAL/FileManager.h"
+
+FMapSyncChangeLog::FMapSyncChangeLog()
+	: Head(0), Count(0), MemoryBytes(0), MemorySize(0), LastSeq(0), SpillSize(0)
+{
+}
+
+FMapSyncChangeLog::~FMapSyncChangeLog()
+{
+	CloseSpillFile();
+}
+
+void FMapSyncChangeLog::Reset(int64 InMemorySize, int64 InSpillSize, const FString& InSpillFilename)
+{
+	CloseSpillFile();
+
+	Ring.Empty();
+	Head = 0;
+	Count = 0;
+	MemoryBytes = 0;
+	MemorySize = InMemorySize;
+	LastSeq = 0;
+	SpillSize = InSpillSize;
+	SpillFilename = InSpillFilename;
+}
+
+void FMapSyncChangeLog::Add(uint32 Seq, const TArray<uint8>& Frame)
+{
+	FEntry Entry;
+	Entry.Seq = Seq;
+	Entry.Frame = Frame;
+	MemoryBytes += Frame.Num();
+	Push(MoveTemp(Entry));
+	LastSeq = Seq;
+
+	// Always keep the last frame in memory, even if it's bigger than the whole log
+	while (MemoryBytes > MemorySize && Count > 1)
+	{
+		FEntry Oldest = Pop();
+		MemoryBytes -= Oldest.Frame.Num();
+		if (SpillSize > 0)
+		{
+			Spill(Oldest);
+		}
+	}
+}
+
+bool FMapSyncChangeLog::GetFramesAfter(uint32 Seq, TArray<TArray<uint8>>& OutFrames)
+{
+	OutFrames.Reset();
+	if (Seq > LastSeq)
+	{
+		return false;
+	}
+
+	// Logged frames are contiguous, so it's enough to check that the one right after Seq is still there
+	const uint32 OldestSeq = SpillIndex.Num() > 0 ? SpillIndex[0].Key : (Count > 0 ? At(0).Seq : LastSeq + 1);
+	if (Seq + 1 < OldestSeq)
+	{
+		return false;
+	}
+
+	// The oldest ones are in the file
+	if (SpillIndex.Num() > 0 && Seq < SpillIndex.Last().Key)
+	{
+		SpillWriter->Flush();
+		TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*SpillFilename, FILEREAD_AllowWrite));
+		if (!Reader)
+		{
+			return false;
+		}
+
+		for (const TPair<uint32, int64>& Spilled : SpillIndex)
+		{
+			if (Spilled.Key <= Seq)
+			{
+				continue;
+			}
+
+			Reader->Seek(Spilled.Value);
+			int32 Size = 0;
+			*Reader << Size;
+			TArray<uint8>& Frame = OutFrames[OutFrames.AddDefaulted()];
+			Frame.SetNumUninitialized(Size);
+			Reader->Serialize(Frame.GetData(), Size);
+		}
+
+		if (Reader->IsError())
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to read the change log back from %s"), *SpillFilename);
+			OutFrames.Reset();
+			return false;
+		}
+	}
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		if (At(i).Seq > Seq)
+		{
+			OutFrames.Add(At(i).Frame);
+		}
+	}
+	return true;
+}
+
+void FMapSyncChangeLog::Push(FEntry&& Entry)
+{
+	// Full, grow it, keeping the entries in order
+	if (Count == Ring.Num())
+	{
+		TArray<FEntry> NewRing;
+		NewRing.SetNum(FMath::Max(16, Ring.Num() * 2));
+		for (int32 i = 0; i < Count; i++)
+		{
+			NewRing[i] = MoveTemp(At(i));
+		}
+		Ring = MoveTemp(NewRing);
+		Head = 0;
+	}
+
+	At(Count) = MoveTemp(Entry);
+	Count++;
+}
+
+FMapSyncChangeLog::FEntry FMapSyncChangeLog::Pop()
+{
+	FEntry Entry = MoveTemp(Ring[Head]);
+	Head = (Head + 1) % Ring.Num();
+	Count--;
+	return Entry;
+}
+
+void FMapSyncChangeLog::Spill(const FEntry& Entry)
+{
+	// Start over when the file is full
+	if (SpillWriter && SpillWriter->Tell() + Entry.Frame.Num() > SpillSize)
+	{
+		CloseSpillFile();
+	}
+
+	if (!SpillWriter)
+	{
+		SpillWriter.Reset(IFileManager::Get().CreateFileWriter(*SpillFilename, FILEWRITE_AllowRead));
+		if (!SpillWriter)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to spill the change log to %s, older frames won't be kept"), *SpillFilename);
+			SpillSize = 0;
+			return;
+		}
+	}
+
+	SpillIndex.Emplace(Entry.Seq, SpillWriter->Tell());
+	int32 Size = Entry.Frame.Num();
+	*SpillWriter << Size;
+	SpillWriter->Serialize(const_cast<uint8*>(Entry.Frame.GetData()), Size);
+}
+
+void FMapSyncChangeLog::CloseSpillFile()
+{
+	SpillIndex.Empty();
+	if (SpillWriter)
+	{
+		SpillWriter.Reset();
+		IFileManager::Get().Delete(*SpillFilename);
+	}
+}
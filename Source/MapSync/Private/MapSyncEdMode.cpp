@@ -5,9 +5,15 @@
 #include "MapSyncEdModeToolkit.h"
 #include "Editor/UnrealEd/Public/Toolkits/ToolkitManager.h"
 #include "Runtime/Core/Public/Logging/MessageLog.h"
+#include "Runtime/Slate/Public/Framework/Notifications/NotificationManager.h"
+#include "Runtime/Slate/Public/Widgets/Notifications/SNotificationList.h"
+#include "Runtime/Core/Public/Misc/HotReloadInterface.h"
+#include "Runtime/Core/Public/Async/ParallelFor.h"
 #include <string>
 
 #include "CustomSerialization.h"
+#include "MapSyncAssetLoader.h"
+#include "MapSyncApplyBatch.h"
 
 #define LOCTEXT_NAMESPACE "MapSyncEditor"
 
@@ -17,37 +23,52 @@ bool FMapSyncEdMode::bIsMapSyncSerialization = false;
 
 // ctor
 FMapSyncEdMode::FMapSyncEdMode()
-	: ConnectionToServer(nullptr), ServerBind(nullptr)
 {
 	bBound = false;
 	bConnectedToServer = false;
 	bActorInit = false;
-	bTimerLambdaSet = false;
-	AccTimeSinceLastCall = 0.f;
+	bApplyingRemoteChanges = false;
+	bWelcomed = false;
+	NextClientSenderId = 1;
+	LastUpdateTime = 0.0;
+	bAdaptiveTick = true;
+	SendInterval = SEND_DEFAULT_INTERVAL / 1000.f;
+	ActiveSendInterval = SEND_DEFAULT_ACTIVE_INTERVAL / 1000.f;
+	IdleSendInterval = SEND_DEFAULT_IDLE_INTERVAL / 1000.f;
+	ResyncWindowSize = RESYNC_DEFAULT_WINDOW_SIZE * 1024;
+	ClientQueueHighWater = CLIENT_QUEUE_DEFAULT_HIGH_WATER * 1024ll;
+	ClientMaxLagTime = CLIENT_DEFAULT_MAX_LAG_TIME;
+	ResyncActorsTotal = 0;
+	ResyncActorsApplied = 0;
+	LastSeq = 0;
+	LastAppliedSeq = 0;
+	DragSendInterval = 0.f;
+	LastDragSendTime = 0.0;
+	ReceivedFrameOffset = 0;
+	ApplyBudget = APPLY_DEFAULT_BUDGET / 1000.f;
+	LastDashboardSampleTime = 0.0;
 }
 
 // dtor
 FMapSyncEdMode::~FMapSyncEdMode()
 {
+	if (GEditor && PostEditorTickHandle.IsValid())
+	{
+		GEditor->OnPostEditorTick().Remove(PostEditorTickHandle);
+	}
+	UnbindChangeDelegates();
+	UnbindSerializerDelegates();
+	ClearActorsByName();
 }
 
 void FMapSyncEdMode::Enter()
 {
 	FEdMode::Enter();
 
-	// Set the main loop timer
-	if (!bTimerLambdaSet)
+	// Set the main loop
+	if (!PostEditorTickHandle.IsValid())
 	{
-		bTimerLambdaSet = true;
-		GEditor->OnPostEditorTick().AddLambda([&](float DeltaTime)
-		{
-			AccTimeSinceLastCall += DeltaTime;
-			if (AccTimeSinceLastCall >= UPDATE_DELAY)
-			{
-				AccTimeSinceLastCall = FMath::Fmod(AccTimeSinceLastCall, UPDATE_DELAY);
-				UpdateMapSync();
-			}
-		});
+		PostEditorTickHandle = GEditor->OnPostEditorTick().AddRaw(this, &FMapSyncEdMode::OnPostEditorTick);
 	}
 	
 	// Create widget
@@ -89,7 +110,9 @@ void FMapSyncEdMode::ConnectToServerAdress(const FString& StringAdress)
 	}
 
 	BuildLastActorsNames();
+	BuildActorsByName();
 	BuildCustomSerializers();
+	BindChangeDelegates();
 	bActorInit = true;
 
 	TArray<FString> IPPortStrs;
@@ -99,14 +122,25 @@ void FMapSyncEdMode::ConnectToServerAdress(const FString& StringAdress)
 		return;
 	}
 
-	FIPv4Address::Parse(*IPPortStrs[0], ServerAdress);
-	ConnectionToServer = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateSocket(NAME_Stream, TEXT("default"), false);
+	// Our sender id is given by the server, in its welcome message
+	StringTable.Reset(0);
+	bWelcomed = false;
+	LoadCompressionSettings();
+	LoadTickSettings();
+
+	float ApplyBudgetMs = APPLY_DEFAULT_BUDGET;
+	if (GConfig)
+	{
+		GConfig->GetFloat(TEXT("MapSync"), TEXT("ApplyBudget"), ApplyBudgetMs, MAPSYNC_INI);
+	}
+	ApplyBudget = ApplyBudgetMs / 1000.f;
+	ReceivedFrames.Empty();
+	ReceivedFrameOffset = 0;
 
-	TSharedRef<FInternetAddr> InetAddr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
-	InetAddr->SetIp(ServerAdress.Value);
-	InetAddr->SetPort(FCString::Atoi(*IPPortStrs[1]));
+	FIPv4Address::Parse(*IPPortStrs[0], ServerAdress);
+	Network = FMapSyncNetworkWorker::Connect(FIPv4Endpoint(ServerAdress, FCString::Atoi(*IPPortStrs[1])));
 
-	bConnectedToServer = ConnectionToServer->Connect(*InetAddr);
+	bConnectedToServer = Network.IsValid();
 	if(!bConnectedToServer)
 	{
 		FMessageLog("PIE").Warning()->AddToken(FTextToken::Create(FText::FromString("MapSync was unable to connect to server !")));
@@ -124,14 +158,169 @@ void FMapSyncEdMode::ResyncClient()
 	char Header = RESYNC_HEADER;
 	DataToSendAr << Header;
 
-	TArray<uint8> DataToSend;
-	AppendArraysToNetData(SerializedData, DataToSend);
-	int32 Sent = 0;
-	ConnectionToServer->Send(DataToSend.GetData(), DataToSend.Num(), Sent);
+	SendFrame(ServerPeerId, MoveTemp(SerializedData));
+}
+
+void FMapSyncEdMode::SendFrame(int32 PeerId, TArray<uint8>&& Frame, int32 ExceptPeerId, bool bDroppable)
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Send);
+
+	FlushPendingStrings();
+	Network->Send(PeerId, MoveTemp(Frame), ExceptPeerId, bDroppable);
+}
+
+void FMapSyncEdMode::FlushPendingStrings()
+{
+	if (!StringTable.HasPendingStrings())
+	{
+		return;
+	}
+
+	// New strings are sent to everyone, even if the frame using them is only sent to some peers, as later frames may use them too
+	TArray<uint64> PendingIds;
+	StringTable.TakePendingStrings(PendingIds);
+
+	TArray<uint8> SerializedData;
+	FMemoryWriter Ar(SerializedData, true);
+	char Header = STRINGS_HEADER;
+	Ar << Header;
+	StringTable.SerializeStrings(Ar, PendingIds);
+
+	Network->Send(bBound ? MAPSYNC_ALL_PEERS : ServerPeerId, MoveTemp(SerializedData));
+}
+
+void FMapSyncEdMode::SendWelcome(int32 ClientId)
+{
+	TArray<uint8> SerializedData;
+	FMemoryWriter Ar(SerializedData, true);
+	char Header = WELCOME_HEADER;
+	Ar << Header;
+	int32 ProtocolVersion = MAPSYNC_PROTOCOL_VERSION;
+	Ar << ProtocolVersion;
+	uint32 SenderId = NextClientSenderId++;
+	Ar << SenderId;
+	Ar << SessionGuid;
+
+	// How the server wants frames to be compressed, the client accepts it or not in its hello
+	FString CompressionFormat = CompressionSettings.Format.ToString();
+	Ar << CompressionFormat;
+	int32 CompressionFlags = CompressionSettings.Flags;
+	Ar << CompressionFlags;
+
+	// Every string known so far, so that the client can read everything that will be sent to it
+	TArray<uint64> AllIds;
+	StringTable.GetAllStrings(AllIds);
+	StringTable.SerializeStrings(Ar, AllIds);
+
+	Network->Send(ClientId, MoveTemp(SerializedData));
+}
+
+void FMapSyncEdMode::SendHello(FName CompressionFormat)
+{
+	TArray<uint8> SerializedData;
+	FMemoryWriter Ar(SerializedData, true);
+	char Header = HELLO_HEADER;
+	Ar << Header;
+	int32 ProtocolVersion = MAPSYNC_PROTOCOL_VERSION;
+	Ar << ProtocolVersion;
+	FString CompressionFormatStr = CompressionFormat.ToString();
+	Ar << CompressionFormatStr;
+
+	// What we already have, if we were connected to this session before
+	Ar << SessionGuid;
+	uint32 Seq = LastAppliedSeq;
+	Ar.SerializeIntPacked(Seq);
+
+	Network->Send(ServerPeerId, MoveTemp(SerializedData));
+}
+
+void FMapSyncEdMode::ApplySequence(uint32 Seq)
+{
+	// After a gap, we're missing updates until told otherwise
+	if (Seq != 0 && Seq == LastAppliedSeq + 1)
+	{
+		LastAppliedSeq = Seq;
+	}
+}
+
+void FMapSyncEdMode::SendSynced(int32 ClientId)
+{
+	// Still lagging or being resynced, it doesn't have everything yet
+	const FClientSendState* State = ClientSendStates.Find(ClientId);
+	if ((State && State->bLagging) || ResyncJobs.ContainsByPredicate([&](const FResyncJob& Job) { return Job.ClientId == ClientId; }))
+	{
+		return;
+	}
+
+	TArray<uint8> SerializedData;
+	FMemoryWriter Ar(SerializedData, true);
+	char Header = SYNCED_HEADER;
+	Ar << Header;
+	uint32 Seq = LastSeq;
+	Ar.SerializeIntPacked(Seq);
+	Network->Send(ClientId, MoveTemp(SerializedData));
+}
+
+bool FMapSyncEdMode::CatchUpClient(int32 ClientId, const FGuid& ClientSessionGuid, uint32 ClientLastSeq)
+{
+	if (ClientSessionGuid != SessionGuid || ClientLastSeq == 0)
+	{
+		return false;
+	}
+
+	TArray<TArray<uint8>> MissedFrames;
+	if (!ChangeLog.GetFramesAfter(ClientLastSeq, MissedFrames))
+	{
+		UE_LOG(LogMapSync, Log, TEXT("Client %d missed too many updates (since %u), resyncing it"), ClientId, ClientLastSeq);
+		return false;
+	}
+
+	// Not droppable, the client then has everything up to the last update without a resync, whatever happens to its queue
+	UE_LOG(LogMapSync, Log, TEXT("Client %d reconnected, sending the %d updates it missed"), ClientId, MissedFrames.Num());
+	for (TArray<uint8>& Frame : MissedFrames)
+	{
+		Network->Send(ClientId, MoveTemp(Frame));
+	}
+	SendSynced(ClientId);
+	return true;
+}
+
+void FMapSyncEdMode::LoadCompressionSettings()
+{
+	FString Format = COMPRESSION_DEFAULT_FORMAT;
+	FString Level;
+	int32 Threshold = COMPRESSION_DEFAULT_THRESHOLD;
+	if (GConfig)
+	{
+		GConfig->GetString(TEXT("MapSync"), TEXT("CompressionFormat"), Format, MAPSYNC_INI);
+		GConfig->GetString(TEXT("MapSync"), TEXT("CompressionLevel"), Level, MAPSYNC_INI);
+		GConfig->GetInt(TEXT("MapSync"), TEXT("CompressionThreshold"), Threshold, MAPSYNC_INI);
+	}
+
+	CompressionSettings = FMapSyncCompressionSettings();
+	if (FMapSyncNetworkWorker::IsCompressionFormatSupported(*Format))
+	{
+		CompressionSettings.Format = *Format;
+	}
+	else if (Format != TEXT("None"))
+	{
+		UE_LOG(LogMapSync, Warning, TEXT("Compression format %s is not supported, frames won't be compressed"), *Format);
+	}
+
+	// Fast is what you want on a LAN, Small on a slow link
+	if (Level == TEXT("Fast"))
+	{
+		CompressionSettings.Flags = COMPRESS_BiasSpeed;
+	}
+	else if (Level == TEXT("Small"))
+	{
+		CompressionSettings.Flags = COMPRESS_BiasMemory;
+	}
+	CompressionSettings.Threshold = Threshold;
 }
 
 
-void FMapSyncEdMode::BindToPort(int32 Port)
+void FMapSyncEdMode::BindToPort(int32 Port, bool bAllowRecording)
 {
 	if (bConnectedToServer || bBound)
 	{
@@ -139,17 +328,53 @@ void FMapSyncEdMode::BindToPort(int32 Port)
 	}
 
 	BuildLastActorsNames();
+	BuildActorsByName();
 	BuildCustomSerializers();
+	BindChangeDelegates();
 	bActorInit = true;
 
-	FIPv4Address::Parse(TEXT("0.0.0.0"), ThisServerAdress);
-	FIPv4Endpoint Endpoint(ThisServerAdress, Port);
-	ServerBind = FTcpSocketBuilder(TEXT("Server"))
-		.AsReusable()
-		.BoundToEndpoint(Endpoint)
-		.Listening(16);
+	int32 WindowSizeKiB = RESYNC_DEFAULT_WINDOW_SIZE;
+	if (GConfig)
+	{
+		GConfig->GetInt(TEXT("MapSync"), TEXT("ResyncWindowSize"), WindowSizeKiB, MAPSYNC_INI);
+	}
+	ResyncWindowSize = FMath::Max(WindowSizeKiB, RESYNC_CHUNK_SIZE / 1024) * 1024ll;
+	ResyncJobs.Empty();
+
+	// A resync alone fills up to ResyncWindowSize, that's not lagging
+	int32 HighWaterKiB = CLIENT_QUEUE_DEFAULT_HIGH_WATER;
+	float MaxLagTime = CLIENT_DEFAULT_MAX_LAG_TIME;
+	if (GConfig)
+	{
+		GConfig->GetInt(TEXT("MapSync"), TEXT("ClientQueueHighWater"), HighWaterKiB, MAPSYNC_INI);
+		GConfig->GetFloat(TEXT("MapSync"), TEXT("ClientMaxLagTime"), MaxLagTime, MAPSYNC_INI);
+	}
+	ClientQueueHighWater = FMath::Max(HighWaterKiB * 1024ll, 2 * ResyncWindowSize + RESYNC_CHUNK_SIZE);
+	ClientMaxLagTime = MaxLagTime;
+	ClientSendStates.Empty();
+
+	// The server always is sender 0
+	StringTable.Reset(0);
+	NextClientSenderId = 1;
+	HelloedClients.Empty();
+	LoadCompressionSettings();
+	LoadTickSettings();
+
+	// New session, numbers start over
+	int32 ChangeLogSizeKiB = CHANGELOG_DEFAULT_SIZE;
+	int32 ChangeLogSpillSizeKiB = CHANGELOG_DEFAULT_SPILL_SIZE;
+	if (GConfig)
+	{
+		GConfig->GetInt(TEXT("MapSync"), TEXT("ChangeLogSize"), ChangeLogSizeKiB, MAPSYNC_INI);
+		GConfig->GetInt(TEXT("MapSync"), TEXT("ChangeLogSpillSize"), ChangeLogSpillSizeKiB, MAPSYNC_INI);
+	}
+	SessionGuid = FGuid::NewGuid();
+	LastSeq = 0;
+	ChangeLog.Reset(ChangeLogSizeKiB * 1024ll, ChangeLogSpillSizeKiB * 1024ll, FPaths::ProjectSavedDir() / TEXT("MapSync") / TEXT("ChangeLog.bin"));
+
+	Network = FMapSyncNetworkWorker::Listen(Port);
 
-	bBound = (ServerBind != nullptr);
+	bBound = Network.IsValid();
 	if (!bBound)
 	{
 		FMessageLog("PIE").Warning()->AddToken(FTextToken::Create(FText::FromString("MapSync was unable to create a server !")));
@@ -158,362 +383,1374 @@ void FMapSyncEdMode::BindToPort(int32 Port)
 	}
 
 	UE_LOG(LogMapSync, Log, TEXT("MapSync successfully created a server ! (Port: %d)"), Port);
+
+	// Recorded from the start, so that a replay sees every client connect
+	bool bRecordSession = RECORD_DEFAULT_SESSION;
+	if (GConfig)
+	{
+		GConfig->GetBool(TEXT("MapSync"), TEXT("RecordSession"), bRecordSession, MAPSYNC_INI);
+	}
+	if (bAllowRecording && bRecordSession)
+	{
+		StartRecording(FPaths::ProjectSavedDir() / TEXT("MapSync") / TEXT("Recordings") / FString::Printf(TEXT("Session-%s.mapsyncrec"), *FDateTime::Now().ToString()));
+	}
+
+	// Joining clients are streamed this snapshot, instead of walking the level for each of them
+	BuildSnapshot();
 }
 
 void FMapSyncEdMode::Cancel()
 {
 	bActorInit = false;
-	if (bConnectedToServer)
+	if (Network.IsValid() && (bConnectedToServer || bBound))
 	{
+		// Tell the server, or all the clients, that we're leaving
 		TArray<uint8> SerializedData;
 		FMemoryWriter DataToSendAr(SerializedData, true);
 		char Header = EXIT_HEADER;
 		DataToSendAr << Header;
 
-		TArray<uint8> DataToSend;
-		AppendArraysToNetData(SerializedData, DataToSend);
-		int32 Sent = 0;
-		ConnectionToServer->Send(DataToSend.GetData(), DataToSend.Num(), Sent);
-
-		ConnectionToServer->Close();
-		bConnectedToServer = false;
+		Network->Send(MAPSYNC_ALL_PEERS, MoveTemp(SerializedData));
 	}
-	if (bBound)
+	// Destroying the worker flushes the exit message and closes every socket
+	Network.Reset();
+	StopRecording();
+	bConnectedToServer = false;
+	bBound = false;
+	bWelcomed = false;
+	Clients.Empty();
+	HelloedClients.Empty();
+	ResyncJobs.Empty();
+	ClientSendStates.Empty();
+	Snapshot.Empty();
+	ChangeLog.Reset(0, 0, FString());
+	FMapSyncApplyBatch::Get().Discard();
+	AppliedActors.Empty();
+	ReceivedFrames.Empty();
+	ReceivedFrameOffset = 0;
+	PeerDashboards.Empty();
+	if (ResyncNotification.IsValid())
 	{
-		ServerBind->Close();
-		bBound = false;
+		UpdateResyncProgress(true);
 	}
+	UnbindChangeDelegates();
+	UnbindSerializerDelegates();
+	ClearActorsByName();
 }
 
-void FMapSyncEdMode::UpdateMapSync()
+bool FMapSyncEdMode::StartRecording(const FString& Filename)
 {
-	// If is connected to a server (aka either client or server)
-	if (bActorInit && bConnectedToServer && ConnectionToServer->GetConnectionState() != SCS_ConnectionError && ConnectionToServer->GetConnectionState() != SCS_NotConnected)
+	if (!bBound || !Network.IsValid())
 	{
-		// If has pending data to treat, retrieve and treat it
-		uint32 ReceivedSize = 0;
-		while (ConnectionToServer && ConnectionToServer->HasPendingData(ReceivedSize))
-		{
-			TArray<uint8> ReceivedData; ReceivedData.SetNum(ReceivedSize);
-			int32 DataRead = 0;
-			ConnectionToServer->Recv(ReceivedData.GetData(), ReceivedSize, DataRead, ESocketReceiveFlags::None);
+		return false;
+	}
 
-			FString ToAdd;
-			for (uint8 it : ReceivedData)
-			{
-				ToAdd += (char)it;
-			}
+	StopRecording();
+	Recorder = FMapSyncRecorder::Create(Filename, MAPSYNC_PROTOCOL_VERSION, GetWorld()->GetOutermost()->GetName());
+	if (!Recorder.IsValid())
+	{
+		UE_LOG(LogMapSync, Warning, TEXT("Unable to record the session to %s"), *Filename);
+		return false;
+	}
 
-			// Split received data into a "understandable" packets, and parse them, and send them to clients
-			TArray<TArray<uint8>> Arrays; NetDataToArrays(ReceivedData, Arrays);
-			for (auto& Array : Arrays)
-			{
-				FMemoryReader ReceivedDataAr(Array);
-				char Header;
-				ReceivedDataAr << Header;
-				if (Header == UPDATE_HEADER)
-				{
-					DeserializeAllActorsChange(ReceivedDataAr);
-				}
-				else if (Header == RESYNC_HEADER)
-				{
-					DeserializeResync(ReceivedDataAr);
-				}
-				else if (Header == EXIT_HEADER)
-				{
-					ConnectionToServer->Close();
-					bConnectedToServer = false;
-					return;
-				}
-			}
-		}
+	Network->SetRecorder(Recorder.Get());
+	UE_LOG(LogMapSync, Log, TEXT("Recording the session to %s"), *Filename);
+	return true;
+}
 
-		// Send local changes!
-		TArray<uint8> SerializedData;
-		FMemoryWriter DataToSendAr(SerializedData, true);
-		char Header = UPDATE_HEADER;
-		DataToSendAr << Header;
-		if (SerializeAllActorsChange(DataToSendAr))
-		{
-			TArray<uint8> DataToSend;
-			AppendArraysToNetData(SerializedData, DataToSend);
-			int32 Sent = 0;
-			ConnectionToServer->Send(DataToSend.GetData(), DataToSend.Num(), Sent);
-		}
+void FMapSyncEdMode::StopRecording()
+{
+	if (Network.IsValid())
+	{
+		Network->SetRecorder(nullptr);
 	}
+	Recorder.Reset();
+}
 
-	// If is a server
-	if (bBound && bActorInit)
+void FMapSyncEdMode::LoadTickSettings()
+{
+	FString Mode = TICK_DEFAULT_MODE;
+	float SendIntervalMs = SEND_DEFAULT_INTERVAL;
+	float ActiveSendIntervalMs = SEND_DEFAULT_ACTIVE_INTERVAL;
+	float IdleSendIntervalMs = SEND_DEFAULT_IDLE_INTERVAL;
+	if (GConfig)
 	{
-		// Remove clients that disconnected
-		for (int32 i = Clients.Num() - 1; i >= 0; i--)
-		{
-			if (!Clients[i] || Clients[i]->GetConnectionState() == SCS_NotConnected || Clients[i]->GetConnectionState() == ESocketConnectionState::SCS_ConnectionError || Clients[i]->GetConnectionState() == ESocketConnectionState::SCS_NotConnected)
-			{
-				Clients[i]->Close();
-				Clients.RemoveAt(i);
+		GConfig->GetString(TEXT("MapSync"), TEXT("TickMode"), Mode, MAPSYNC_INI);
+		GConfig->GetFloat(TEXT("MapSync"), TEXT("SendInterval"), SendIntervalMs, MAPSYNC_INI);
+		GConfig->GetFloat(TEXT("MapSync"), TEXT("ActiveSendInterval"), ActiveSendIntervalMs, MAPSYNC_INI);
+		GConfig->GetFloat(TEXT("MapSync"), TEXT("IdleSendInterval"), IdleSendIntervalMs, MAPSYNC_INI);
+	}
 
-				UE_LOG(LogMapSync, Log, TEXT("A client disconnected"));
-			}
-		}
+	bAdaptiveTick = Mode != TEXT("Fixed");
+	SendInterval = SendIntervalMs / 1000.f;
+	ActiveSendInterval = ActiveSendIntervalMs / 1000.f;
+	IdleSendInterval = IdleSendIntervalMs / 1000.f;
+}
 
-		// If has a pending client wanting to connect, accept it
-		bool bHasPendingConnection;
-		ServerBind->HasPendingConnection(bHasPendingConnection);
-		while (bHasPendingConnection)
-		{
-			int32 NewClientIdx = Clients.Add(ServerBind->Accept(TEXT("client") + FString::FromInt(FMath::RandHelper(1000000))));
-			UE_LOG(LogMapSync, Log, TEXT("A client connected to this server: %s"), *Clients[NewClientIdx]->GetDescription());
+void FMapSyncEdMode::OnPostEditorTick(float DeltaTime)
+{
+	if (!bActorInit || !Network.IsValid())
+	{
+		return;
+	}
 
-			ServerBind->HasPendingConnection(bHasPendingConnection);
-		}
+	// Don't wait to handle what was received, nor to continue what's being streamed or applied
+	const double Now = FPlatformTime::Seconds();
+	const bool bHasWork = Network->HasInbound() || ReceivedFrames.Num() > 0 || ResyncJobs.Num() > 0;
+	if (bHasWork || Now - LastUpdateTime >= GetSendInterval())
+	{
+		LastUpdateTime = Now;
+		UpdateMapSync();
+	}
+}
 
-		// Array into which we'll store the things to send to everybody
-		TArray<TPair<FSocket*, TArray<uint8>>> ArraysToMulticast;
+float FMapSyncEdMode::GetSendInterval() const
+{
+	if (!bAdaptiveTick)
+	{
+		return SendInterval;
+	}
 
-		// Send to all clients what was just received, and parse it live
-		for (int32 ClientSocketIdx = Clients.Num() - 1; ClientSocketIdx >= 0; ClientSocketIdx--)
-		{
-			FSocket* ClientSocket = Clients[ClientSocketIdx];
+	// Fast while something is being edited, so that peers see it right away, and slow when idle
+	const bool bEditing = MovingActors.Num() > 0 || DirtyActors.Num() > 0 || PendingRemovedActors.Num() > 0;
+	return bEditing ? ActiveSendInterval : IdleSendInterval;
+}
 
-			uint32 ReceivedSize = 0;
-			while (ClientSocket && ClientSocket->HasPendingData(ReceivedSize))
-			{
-				// Receive raw data, into ReceivedData
-				TArray<uint8> ReceivedData; ReceivedData.SetNum(ReceivedSize);
-				int32 DataRead = 0;
-				ClientSocket->Recv(ReceivedData.GetData(), ReceivedSize, DataRead, ESocketReceiveFlags::None);
-				
-				// The received and pending data size have to be the same, otherwise, something might be wrong
-				if (DataRead != ReceivedSize)
-				{
-					UE_LOG(LogMapSync, Warning, TEXT("DataRead != ReceivedSize (%d vs %d)"), DataRead, ReceivedSize);
-				}
+void FMapSyncEdMode::UpdateMapSync()
+{
+	if (!bActorInit || !Network.IsValid())
+	{
+		return;
+	}
 
-				// Split ReceivedData into a "understandable" packets (aka Arrays), and parse them, and send them to clients
-				TArray<TArray<uint8>> Arrays; NetDataToArrays(ReceivedData, Arrays);
-				for (auto& Array : Arrays)
-				{
-					FMemoryReader ReceivedDataAr(Array);
-					char Header;
-					ReceivedDataAr << Header;
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Update);
+	SET_DWORD_STAT(STAT_MapSyncDirtyActors, DirtyActors.Num() + MovingActors.Num());
+	SET_DWORD_STAT(STAT_MapSyncReceivedFrames, ReceivedFrames.Num());
+	SET_DWORD_STAT(STAT_MapSyncResyncJobs, ResyncJobs.Num());
+	int64 MaxQueuedBytes = bConnectedToServer ? Network->GetQueuedBytes(ServerPeerId) : 0;
+	for (int32 ClientId : Clients)
+	{
+		MaxQueuedBytes = FMath::Max(MaxQueuedBytes, Network->GetQueuedBytes(ClientId));
+	}
+	SET_MEMORY_STAT(STAT_MapSyncQueuedBytes, MaxQueuedBytes);
 
-					bool bShouldMulticast = true;
-					if (Header == UPDATE_HEADER)
-					{
-						DeserializeAllActorsChange(ReceivedDataAr);
-					}
-					else if (Header == RESYNC_HEADER)
-					{
-						ResyncToClient(ClientSocketIdx);
-					}
-					else if (Header == EXIT_HEADER)
-					{
-						bShouldMulticast = false;
-						ClientSocket->Close();
-						Clients.RemoveAt(ClientSocketIdx);
-					}
+	// If is connected to a server
+	if (bConnectedToServer)
+	{
+		// Queue everything the network worker received since last time, it's applied in order within the apply budget
+		const bool bDisconnected = !ReceiveFromServer();
 
-					if (bShouldMulticast)
-					{
-						ArraysToMulticast.Add(TPairInitializer<FSocket*, TArray<uint8>>(ClientSocket, Array));
-					}
-				}
-			}
-		}
+		// Once disconnected, apply everything that was received before leaving
+		const bool bStaying = ApplyReceivedFrames(!bDisconnected);
 
-		// Send the data we just received to all clients (except the one that sent it)
-		for (int32 ClientSocketIdx = 0; ClientSocketIdx < Clients.Num(); ClientSocketIdx++)
-		{
-			TArray<uint8> ArrayToMulticast;
-			for (auto& Array : ArraysToMulticast)
-			{
-				if (Array.Key != Clients[ClientSocketIdx])
-				{
-					AppendArraysToNetData(Array.Value, ArrayToMulticast);
-				}
-			}
+		// Apply what was received, once per actor
+		FlushRemoteChanges();
 
-			if (ArrayToMulticast.Num() > 0)
+		if (bDisconnected || !bStaying)
+		{
+			Network.Reset();
+			bConnectedToServer = false;
+			ReceivedFrames.Empty();
+			ReceivedFrameOffset = 0;
+			PeerDashboards.Empty();
+			if (ResyncNotification.IsValid())
 			{
-				int32 Sent = 0;
-				Clients[ClientSocketIdx]->Send(ArrayToMulticast.GetData(), ArrayToMulticast.Num(), Sent);
+				UpdateResyncProgress(true);
 			}
+			return;
 		}
 
-		// If has data to send because of local changes, send it
+		// Send local changes! Until welcomed, we can't allocate strings, so they stay dirty
 		TArray<uint8> SerializedData;
-		FMemoryWriter DataToSendAr(SerializedData, true);
+		FMapSyncWriter DataToSendAr(SerializedData, StringTable);
 		char Header = UPDATE_HEADER;
 		DataToSendAr << Header;
-		if (SerializeAllActorsChange(DataToSendAr))
+		if (bWelcomed && SerializeAllActorsChange(DataToSendAr))
 		{
-			TArray<uint8> DataToSend;
-			AppendArraysToNetData(SerializedData, DataToSend);
-			for (int32 ClientSocketIdx = 0; ClientSocketIdx < Clients.Num(); ClientSocketIdx++)
-			{
-				int32 Sent = 0;
-				Clients[ClientSocketIdx]->Send(DataToSend.GetData(), DataToSend.Num(), Sent);
-			}
+			SendFrame(ServerPeerId, MoveTemp(SerializedData));
 		}
 	}
-}
-
-void FMapSyncEdMode::ResyncToClient(int32 ClientIdx)
-{
-	TArray<uint8> SerializedData;
-	FMemoryWriter Ar(SerializedData, true);
-	char Header = RESYNC_HEADER;
-	Ar << Header;
 
-	for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+	// If is a server
+	if (bBound)
 	{
-		// Serialize actor name
-		FString ActorName = ActorIt->GetFName().ToString();
-		Ar << ActorName;
+		// Treat connections, disconnections, and what clients sent
+		ReceiveFromClients();
 
-		// Serialize actor creation -> If is a BP class
-		if (ActorIt->GetClass()->GetClass()->IsChildOf<UBlueprintGeneratedClass>())
-		{
-			char CreateFlag = BPCLASS_CREATEFLAG;
-			Ar << CreateFlag;
+		// Apply what was received, once per actor
+		FlushRemoteChanges();
 
-			FString Path = ActorIt->GetClass()->GetPathName();
-			Ar << Path;
-		}
-		// If is a CPP class
-		else
+		// If has data to send because of local changes, send it
+		TArray<uint8> SerializedData;
+		FMapSyncWriter DataToSendAr(SerializedData, StringTable);
+		char Header = UPDATE_HEADER;
+		DataToSendAr << Header;
+		FUpdateSummary Summary;
+		if (SerializeAllActorsChange(DataToSendAr, &Summary))
 		{
-			char CreateFlag = CPPCLASS_CREATEFLAG;
-			Ar << CreateFlag;
-
-			FString ClassName = ActorIt->GetClass()->GetFName().ToString();
-			Ar << ClassName;
+			BroadcastUpdate(SerializedData, INDEX_NONE, Summary);
 		}
 
-		// Serialize actor update
-		SerializeOneActorMod(*ActorIt, Ar);
-	}
-
-	const FText Title = LOCTEXT("ResyncServerTitle", "Resync");
-	
-	int32 Size = SerializedData.Num();
-	FString TheNum = "";
+		// Continue streaming resyncs
+		TickResyncJobs();
 
-	if (Size > 1073741824) TheNum = FString::Printf(TEXT("%4.2f GiB"), static_cast<float>(Size) / 1073741824.f);
-	else if (Size > 1048576) TheNum = FString::Printf(TEXT("%4.2f MiB"), static_cast<float>(Size) / 1048576.f);
-	else if (Size > 1024) TheNum = FString::Printf(TEXT("%4.2f kiB"), static_cast<float>(Size) / 1024.f);
-	else TheNum = FString::Printf(TEXT("%d bytes"), Size);
+		// Check which clients can't keep up
+		TickSlowClients();
+	}
 
-	// Warn the user that this may result in too much data being sent
-	FSuppressableWarningDialog::FSetupInfo SetupInfo(FText::FromString("Warning, this update will be " + TheNum + ". Proceed?"), Title, "Warning_ResyncTitle");
-	SetupInfo.ConfirmText = LOCTEXT("ResyncServerYesButton", "Yes");
-	SetupInfo.CancelText = LOCTEXT("ResyncServerNoButton", "No");
-	SetupInfo.CheckBoxText = FText::GetEmpty();	// not suppressible
+	TickDashboard();
+}
 
-	FSuppressableWarningDialog ReparentBlueprintDlg(SetupInfo);
-	if (ReparentBlueprintDlg.ShowModal() == FSuppressableWarningDialog::Confirm)
+bool FMapSyncEdMode::ReceiveFromServer()
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Receive);
+	FMapSyncNetInbound Inbound;
+	while (Network->Dequeue(Inbound))
 	{
-		TArray<uint8> DataToSend;
-		AppendArraysToNetData(SerializedData, DataToSend);
-		int32 Sent = 0;
-		Clients[ClientIdx]->Send(DataToSend.GetData(), DataToSend.Num(), Sent);
+		if (Inbound.Event == EMapSyncNetEvent::Disconnected)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("MapSync lost the connection to the server"));
+			return false;
+		}
+		if (Inbound.Event == EMapSyncNetEvent::Connected)
+		{
+			// The server talks first
+			PeerDashboards.FindOrAdd(ServerPeerId).Stats = Inbound.Stats;
+			continue;
+		}
+
+		// Answered right away, so that the round trip time doesn't include the frames waiting to be applied
+		if (Inbound.Payload.Num() > 0 && (Inbound.Payload[0] == PING_HEADER || Inbound.Payload[0] == PONG_HEADER))
+		{
+			OnPingFrame(ServerPeerId, Inbound.Payload);
+			continue;
+		}
+		ReceivedFrames.Add(MoveTemp(Inbound.Payload));
 	}
+	return true;
 }
 
-void FMapSyncEdMode::DeserializeResync(FMemoryReader& Ar)
+void FMapSyncEdMode::ReceiveFromClients()
 {
-	while (!Ar.AtEnd())
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Receive);
+	FMapSyncNetInbound Inbound;
+	while (Network->Dequeue(Inbound))
 	{
-		// Deserialize vars
-		FString ActorName; Ar << ActorName;
-		char CreateFlag; Ar << CreateFlag;
-		FString Path; Ar << Path;
-
-		// Try to find the actor
-		AActor* FoundActor = nullptr;
-		for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+		if (Inbound.Event == EMapSyncNetEvent::Connected)
 		{
-			if (ActorIt->GetFName().ToString() == ActorName)
-			{
-				FoundActor = *ActorIt;
-			}
+			Clients.Add(Inbound.PeerId);
+			PeerDashboards.FindOrAdd(Inbound.PeerId).Stats = Inbound.Stats;
+			SendWelcome(Inbound.PeerId);
+			UE_LOG(LogMapSync, Log, TEXT("A client connected to this server (id: %d)"), Inbound.PeerId);
+			continue;
 		}
-		// If we can't find it, create it
-		if (!FoundActor)
+		if (Inbound.Event == EMapSyncNetEvent::Disconnected)
 		{
-			if (CreateFlag == BPCLASS_CREATEFLAG)
+			Clients.Remove(Inbound.PeerId);
+			HelloedClients.Remove(Inbound.PeerId);
+			ResyncJobs.RemoveAll([&](const FResyncJob& Job) { return Job.ClientId == Inbound.PeerId; });
+			ClientSendStates.Remove(Inbound.PeerId);
+			PeerDashboards.Remove(Inbound.PeerId);
+			UE_LOG(LogMapSync, Log, TEXT("A client disconnected"));
+			continue;
+		}
+
+		FMapSyncReader ReceivedDataAr(Inbound.Payload, StringTable);
+		char Header;
+		ReceivedDataAr << Header;
+
+		// The first thing a client sends is its protocol version
+		if (!HelloedClients.Contains(Inbound.PeerId))
+		{
+			int32 ProtocolVersion = 0;
+			FString ClientCompressionFormat;
+			FGuid ClientSessionGuid;
+			uint32 ClientLastSeq = 0;
+			if (Header == HELLO_HEADER)
 			{
-				UClass* FoundClass = LoadClass<AActor>(nullptr, *Path);
-				if (FoundClass)
+				ReceivedDataAr << ProtocolVersion;
+				if (ProtocolVersion == MAPSYNC_PROTOCOL_VERSION)
 				{
-					FActorSpawnParameters ASP;
-					ASP.Name = FName(*ActorName);
-
-					FoundActor = GetWorld()->SpawnActor<AActor>(FoundClass, ASP);
+					ReceivedDataAr << ClientCompressionFormat;
+					ReceivedDataAr << ClientSessionGuid;
+					ReceivedDataAr.SerializeIntPacked(ClientLastSeq);
 				}
 			}
-			else if (CreateFlag == CPPCLASS_CREATEFLAG)
+			if (ProtocolVersion != MAPSYNC_PROTOCOL_VERSION)
 			{
-				for (TObjectIterator<UClass> It; It; ++It)
-				{
-					if ((*It) && It->GetFName().ToString() == Path)
-					{
-						FActorSpawnParameters ASP;
-						ASP.Name = FName(*ActorName);
+				UE_LOG(LogMapSync, Warning, TEXT("Client %d uses protocol version %d, this editor uses version %d. Disconnecting it"), Inbound.PeerId, ProtocolVersion, MAPSYNC_PROTOCOL_VERSION);
+
+				TArray<uint8> SerializedData;
+				FMemoryWriter DataToSendAr(SerializedData, true);
+				char ExitHeader = EXIT_HEADER;
+				DataToSendAr << ExitHeader;
+				Network->Send(Inbound.PeerId, MoveTemp(SerializedData));
+				Network->Close(Inbound.PeerId);
+				continue;
+			}
 
-						FoundActor = GetWorld()->SpawnActor<AActor>(*It, ASP);
-						break;
-					}
-				}
+			// The client either accepted our compression, or doesn't want any
+			if (CompressionSettings.Format != NAME_None && FName(*ClientCompressionFormat) == CompressionSettings.Format)
+			{
+				Network->SetCompression(Inbound.PeerId, CompressionSettings);
 			}
-		}
 
-		// If an actor to modify is selected, unselect it
-		for (FSelectionIterator SelectionIt = GEditor->GetSelectedActorIterator(); SelectionIt; ++SelectionIt)
-		{
-			if (FoundActor == *SelectionIt)
+			HelloedClients.Add(Inbound.PeerId);
+
+			// Bring it up to date right away, with what it missed if it was here before, or a resync. Updates sent meanwhile are interleaved with the chunks, in order
+			if (!CatchUpClient(Inbound.PeerId, ClientSessionGuid, ClientLastSeq))
 			{
-				GEditor->GetSelectedActors()->Deselect(FoundActor);
-				break;
+				ResyncToClient(Inbound.PeerId);
 			}
+			continue;
 		}
 
-		// Apply serializers
-		for (auto& Serializer : CustomSerializers)
+		bool bShouldMulticast = true;
+		if (Header == STRINGS_HEADER)
 		{
-			if (FoundActor->GetClass()->IsChildOf(Serializer->GetSupportedClass()) || FoundActor->GetClass() == Serializer->GetSupportedClass())
+			StringTable.DeserializeStrings(ReceivedDataAr);
+		}
+		else if (Header == UPDATE_HEADER)
+		{
+			bShouldMulticast = false;
+			FUpdateSummary Summary;
+			{
+				MAPSYNC_SCOPE_CYCLE_COUNTER(Decode);
+				DeserializeAllActorsChange(ReceivedDataAr, &Summary);
+			}
+			BroadcastUpdate(Inbound.Payload, Inbound.PeerId, Summary);
+		}
+		else if (Header == RESYNC_HEADER)
+		{
+			bShouldMulticast = false;
+			ResyncToClient(Inbound.PeerId);
+		}
+		else if (Header == PING_HEADER || Header == PONG_HEADER)
+		{
+			bShouldMulticast = false;
+			OnPingFrame(Inbound.PeerId, Inbound.Payload);
+		}
+		else if (Header == EXIT_HEADER)
+		{
+			bShouldMulticast = false;
+			Network->Close(Inbound.PeerId);
+		}
+
+		// Send the data we just received to all clients (except the one that sent it)
+		if (bShouldMulticast)
+		{
+			Network->Send(MAPSYNC_ALL_PEERS, MoveTemp(Inbound.Payload), Inbound.PeerId);
+		}
+	}
+}
+
+void FMapSyncEdMode::TickDashboard()
+{
+	const double Now = FPlatformTime::Seconds();
+	const double Elapsed = Now - LastDashboardSampleTime;
+	if (Elapsed < DASHBOARD_SAMPLE_INTERVAL)
+	{
+		return;
+	}
+	LastDashboardSampleTime = Now;
+
+	for (auto& PeerDashboard : PeerDashboards)
+	{
+		FMapSyncPeerDashboard& Dashboard = PeerDashboard.Value;
+		if (Dashboard.Stats.IsValid())
+		{
+			const int64 BytesIn = Dashboard.Stats->BytesReceived.GetValue();
+			const int64 BytesOut = Dashboard.Stats->BytesSent.GetValue();
+			Dashboard.BytesInPerSec = (BytesIn - Dashboard.LastBytesIn) / Elapsed;
+			Dashboard.BytesOutPerSec = (BytesOut - Dashboard.LastBytesOut) / Elapsed;
+			Dashboard.LastBytesIn = BytesIn;
+			Dashboard.LastBytesOut = BytesOut;
+			Dashboard.Throughput.Add(Dashboard.BytesInPerSec + Dashboard.BytesOutPerSec);
+		}
+
+		// A client knows how far its own resync went, the server how much of each client's it sent
+		Dashboard.ResyncProgress = -1.f;
+		if (bBound)
+		{
+			const FResyncJob* Job = ResyncJobs.FindByPredicate([&](const FResyncJob& OtherJob) { return OtherJob.ClientId == PeerDashboard.Key; });
+			if (Job)
+			{
+				Dashboard.ResyncProgress = Job->Actors.Num() > 0 ? static_cast<float>(Job->NextActorIdx) / Job->Actors.Num() : 1.f;
+			}
+		}
+		else if (ResyncNotification.IsValid())
+		{
+			Dashboard.ResyncProgress = ResyncActorsTotal > 0 ? FMath::Min(1.f, static_cast<float>(ResyncActorsApplied) / ResyncActorsTotal) : 0.f;
+		}
+	}
+
+	// Clients may only talk once they said hello
+	if (bBound)
+	{
+		for (int32 ClientId : HelloedClients)
+		{
+			SendPing(ClientId);
+		}
+	}
+	else if (bWelcomed)
+	{
+		SendPing(ServerPeerId);
+	}
+}
+
+void FMapSyncEdMode::SendPing(int32 PeerId)
+{
+	TArray<uint8> SerializedData;
+	FMemoryWriter Ar(SerializedData, true);
+	char Header = PING_HEADER;
+	Ar << Header;
+	double Time = FPlatformTime::Seconds();
+	Ar << Time;
+	Network->Send(PeerId, MoveTemp(SerializedData), INDEX_NONE, true);
+}
+
+void FMapSyncEdMode::OnPingFrame(int32 PeerId, const TArray<uint8>& Frame)
+{
+	FMemoryReader Ar(Frame);
+	char Header;
+	Ar << Header;
+	double Time = 0.0;
+	Ar << Time;
+
+	// The time is sent back as is, only the side that pinged reads its own clock
+	if (Header == PING_HEADER)
+	{
+		TArray<uint8> SerializedData;
+		FMemoryWriter PongAr(SerializedData, true);
+		char PongHeader = PONG_HEADER;
+		PongAr << PongHeader;
+		PongAr << Time;
+		uint32 Seq = GetLocalSeq();
+		PongAr.SerializeIntPacked(Seq);
+		Network->Send(PeerId, MoveTemp(SerializedData), INDEX_NONE, true);
+		return;
+	}
+
+	FMapSyncPeerDashboard* Dashboard = PeerDashboards.Find(PeerId);
+	if (Dashboard && !Ar.IsError())
+	{
+		Dashboard->Rtt = FPlatformTime::Seconds() - Time;
+		Ar.SerializeIntPacked(Dashboard->Seq);
+	}
+}
+
+bool FMapSyncEdMode::ApplyReceivedFrames(bool bWithinBudget)
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Decode);
+
+	// Frames are applied in the order they were received, so that actors are created before being updated, and strings defined before being used
+	const double EndTime = bWithinBudget && ApplyBudget > 0.f ? FPlatformTime::Seconds() + ApplyBudget : 0.0;
+	int32 FrameIdx = 0;
+	for (; FrameIdx < ReceivedFrames.Num(); FrameIdx++)
+	{
+		// Out of time, the rest waits for next tick
+		if (EndTime > 0.0 && FPlatformTime::Seconds() >= EndTime)
+		{
+			break;
+		}
+
+		FMapSyncReader ReceivedDataAr(ReceivedFrames[FrameIdx], StringTable);
+		char Header;
+		ReceivedDataAr << Header;
+		if (Header == WELCOME_HEADER)
+		{
+			int32 ProtocolVersion = 0;
+			ReceivedDataAr << ProtocolVersion;
+			if (ProtocolVersion != MAPSYNC_PROTOCOL_VERSION)
+			{
+				FMessageLog("PIE").Warning()->AddToken(FTextToken::Create(FText::FromString("MapSync server uses a different version of the plugin !")));
+				UE_LOG(LogMapSync, Warning, TEXT("MapSync server uses protocol version %d, this editor uses version %d"), ProtocolVersion, MAPSYNC_PROTOCOL_VERSION);
+				Cancel();
+				return false;
+			}
+
+			uint32 SenderId = 0;
+			ReceivedDataAr << SenderId;
+			FGuid ServerSessionGuid;
+			ReceivedDataAr << ServerSessionGuid;
+
+			// Use the server's compression, unless we don't compress, or can't
+			FString ServerCompressionFormat;
+			ReceivedDataAr << ServerCompressionFormat;
+			int32 ServerCompressionFlags = COMPRESS_NoFlags;
+			ReceivedDataAr << ServerCompressionFlags;
+			FMapSyncCompressionSettings ServerCompression;
+			if (CompressionSettings.Format != NAME_None && FMapSyncNetworkWorker::IsCompressionFormatSupported(*ServerCompressionFormat))
+			{
+				ServerCompression.Format = *ServerCompressionFormat;
+				ServerCompression.Flags = (ECompressionFlags)ServerCompressionFlags;
+				ServerCompression.Threshold = CompressionSettings.Threshold;
+			}
+
+			StringTable.SetLocalSenderId(SenderId);
+			StringTable.DeserializeStrings(ReceivedDataAr);
+			SendHello(ServerCompression.Format);
+			Network->SetCompression(ServerPeerId, ServerCompression);
+			bWelcomed = true;
+
+			// Numbers from another session mean nothing, we'll be told where we are once resynced
+			if (ServerSessionGuid != SessionGuid)
+			{
+				SessionGuid = ServerSessionGuid;
+				LastAppliedSeq = 0;
+			}
+		}
+		else if (Header == STRINGS_HEADER)
+		{
+			StringTable.DeserializeStrings(ReceivedDataAr);
+		}
+		else if (Header == UPDATE_HEADER)
+		{
+			uint32 Seq = 0;
+			ReceivedDataAr.SerializeIntPacked(Seq);
+
+			// Resume where we stopped last tick, past the level check
+			bool bFinished = false;
+			if (ReceivedFrameOffset > 0)
+			{
+				ReceivedDataAr.Seek(ReceivedFrameOffset);
+				bFinished = DeserializeActorCommands(ReceivedDataAr, nullptr, EndTime);
+			}
+			else
+			{
+				bFinished = DeserializeAllActorsChange(ReceivedDataAr, nullptr, EndTime);
+			}
+			if (!bFinished)
+			{
+				ReceivedFrameOffset = ReceivedDataAr.Tell();
+				break;
+			}
+			ReceivedFrameOffset = 0;
+			ApplySequence(Seq);
+		}
+		else if (Header == SEQUENCE_HEADER)
+		{
+			uint32 Seq = 0;
+			ReceivedDataAr.SerializeIntPacked(Seq);
+			ApplySequence(Seq);
+		}
+		else if (Header == SYNCED_HEADER)
+		{
+			ReceivedDataAr.SerializeIntPacked(LastAppliedSeq);
+		}
+		else if (Header == RESYNCBEGIN_HEADER)
+		{
+			ReceivedDataAr << ResyncActorsTotal;
+			ResyncActorsApplied = 0;
+			UpdateResyncProgress(false);
+		}
+		else if (Header == RESYNC_HEADER)
+		{
+			if (ReceivedFrameOffset > 0)
+			{
+				ReceivedDataAr.Seek(ReceivedFrameOffset);
+			}
+			ResyncActorsApplied += DeserializeResync(ReceivedDataAr, EndTime);
+			UpdateResyncProgress(false);
+			if (!ReceivedDataAr.AtEnd())
+			{
+				ReceivedFrameOffset = ReceivedDataAr.Tell();
+				break;
+			}
+			ReceivedFrameOffset = 0;
+		}
+		else if (Header == RESYNCEND_HEADER)
+		{
+			UpdateResyncProgress(true);
+		}
+		else if (Header == EXIT_HEADER)
+		{
+			return false;
+		}
+	}
+
+	ReceivedFrames.RemoveAt(0, FrameIdx);
+	return true;
+}
+
+void FMapSyncEdMode::ResyncToClient(int32 ClientId)
+{
+	// Only gather the actor names now, their snapshot is read chunk by chunk as the client receives them, so that it's the latest one
+	FResyncJob Job;
+	Job.ClientId = ClientId;
+	Job.NextActorIdx = 0;
+	Snapshot.GenerateKeyArray(Job.Actors);
+
+	UE_LOG(LogMapSync, Log, TEXT("Streaming a resync of %d actors to client %d"), Job.Actors.Num(), ClientId);
+
+	TArray<uint8> SerializedData;
+	FMemoryWriter Ar(SerializedData, true);
+	char Header = RESYNCBEGIN_HEADER;
+	Ar << Header;
+	int32 ActorCount = Job.Actors.Num();
+	Ar << ActorCount;
+	Network->Send(ClientId, MoveTemp(SerializedData), INDEX_NONE, true);
+
+	// If this client was already being resynced, start over
+	ResyncJobs.RemoveAll([&](const FResyncJob& OtherJob) { return OtherJob.ClientId == ClientId; });
+	ResyncJobs.Add(MoveTemp(Job));
+}
+
+void FMapSyncEdMode::TickResyncJobs()
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Resync);
+
+	for (int32 JobIdx = ResyncJobs.Num() - 1; JobIdx >= 0; JobIdx--)
+	{
+		FResyncJob& Job = ResyncJobs[JobIdx];
+
+		// Only send more when what was sent before went out, so that at most ResyncWindowSize bytes are waiting
+		while (Job.NextActorIdx < Job.Actors.Num() && Network->GetQueuedBytes(Job.ClientId) < ResyncWindowSize)
+		{
+			TArray<uint8> SerializedData;
+			FMemoryWriter Ar(SerializedData, true);
+			char Header = RESYNC_HEADER;
+			Ar << Header;
+
+			while (Job.NextActorIdx < Job.Actors.Num() && SerializedData.Num() < RESYNC_CHUNK_SIZE)
+			{
+				// Actors removed since the resync started are skipped
+				const FSnapshotActor* Entry = Snapshot.Find(Job.Actors[Job.NextActorIdx++]);
+				if (Entry)
+				{
+					AppendSnapshotActor(*Entry, SerializedData);
+				}
+			}
+
+			SendFrame(Job.ClientId, MoveTemp(SerializedData), INDEX_NONE, true);
+		}
+
+		if (Job.NextActorIdx >= Job.Actors.Num())
+		{
+			TArray<uint8> SerializedData;
+			FMemoryWriter Ar(SerializedData, true);
+			char Header = RESYNCEND_HEADER;
+			Ar << Header;
+			Network->Send(Job.ClientId, MoveTemp(SerializedData), INDEX_NONE, true);
+
+			UE_LOG(LogMapSync, Log, TEXT("Finished streaming a resync to client %d"), Job.ClientId);
+			const int32 ClientId = Job.ClientId;
+			ResyncJobs.RemoveAt(JobIdx);
+			SendSynced(ClientId);
+		}
+	}
+}
+
+void FMapSyncEdMode::BroadcastUpdate(const TArray<uint8>& Update, int32 ExceptPeerId, const FUpdateSummary& Summary)
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Send);
+
+	FlushPendingStrings();
+
+	// Number the update, and log it for clients that reconnect
+	const uint32 Seq = ++LastSeq;
+	TArray<uint8> Frame;
+	FMemoryWriter FrameAr(Frame, true);
+	char Header = UPDATE_HEADER;
+	FrameAr << Header;
+	uint32 FrameSeq = Seq;
+	FrameAr.SerializeIntPacked(FrameSeq);
+	FrameAr.Serialize(const_cast<uint8*>(Update.GetData()) + 1, Update.Num() - 1);
+	ChangeLog.Add(Seq, Frame);
+
+	// A resync only creates and updates actors, so only frames it makes up for may be dropped for a client that can't keep up. Removals and renames must get through
+	const bool bDroppable = Summary.bCoalescable;
+
+	// The client that sent it already has it, it only needs its number
+	if (ExceptPeerId != INDEX_NONE)
+	{
+		TArray<uint8> SequenceData;
+		FMemoryWriter SequenceAr(SequenceData, true);
+		char SequenceHeader = SEQUENCE_HEADER;
+		SequenceAr << SequenceHeader;
+		SequenceAr.SerializeIntPacked(FrameSeq);
+		Network->Send(ExceptPeerId, MoveTemp(SequenceData), INDEX_NONE, bDroppable);
+	}
+
+	// Lagging clients only remember which actors changed, and get their latest state once they caught up
+	TArray<int32> Recipients;
+	bool bSomeLagging = false;
+	for (int32 ClientId : Clients)
+	{
+		if (ClientId == ExceptPeerId)
+		{
+			continue;
+		}
+
+		FClientSendState* State = ClientSendStates.Find(ClientId);
+		if (State && State->bLagging && Summary.bCoalescable)
+		{
+			State->CoalescedActors.Append(Summary.UpdatedActors);
+			bSomeLagging = true;
+			continue;
+		}
+		Recipients.Add(ClientId);
+	}
+
+	if (!bSomeLagging)
+	{
+		Network->Send(MAPSYNC_ALL_PEERS, MoveTemp(Frame), ExceptPeerId, bDroppable);
+	}
+	else
+	{
+		Network->Multicast(Recipients, MoveTemp(Frame), bDroppable);
+	}
+}
+
+void FMapSyncEdMode::TickSlowClients()
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Send);
+
+	const double Now = FPlatformTime::Seconds();
+	for (int32 ClientId : Clients)
+	{
+		FClientSendState& State = ClientSendStates.FindOrAdd(ClientId);
+		const int64 QueuedBytes = Network->GetQueuedBytes(ClientId);
+
+		if (!State.bLagging)
+		{
+			if (QueuedBytes > ClientQueueHighWater)
+			{
+				UE_LOG(LogMapSync, Log, TEXT("Client %d is lagging behind (%lld bytes queued), coalescing its updates"), ClientId, QueuedBytes);
+				State.bLagging = true;
+				State.LaggingSince = Now;
+			}
+			continue;
+		}
+
+		// Caught up, send what it missed
+		if (QueuedBytes < ClientQueueHighWater / 2)
+		{
+			UE_LOG(LogMapSync, Log, TEXT("Client %d caught up, sending %d coalesced actor updates"), ClientId, State.CoalescedActors.Num());
+			SendCoalescedUpdates(ClientId, State);
+			State.bLagging = false;
+			SendSynced(ClientId);
+			continue;
+		}
+
+		// Lagging for too long, what's queued is probably stale anyway. Start it over from the current state
+		if (Now - State.LaggingSince > ClientMaxLagTime)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Client %d couldn't catch up for %.0f seconds, resyncing it"), ClientId, Now - State.LaggingSince);
+			Network->DropQueued(ClientId);
+			State.bLagging = false;
+			State.CoalescedActors.Empty();
+			ResyncToClient(ClientId);
+		}
+	}
+}
+
+void FMapSyncEdMode::SendCoalescedUpdates(int32 ClientId, FClientSendState& State)
+{
+	if (State.CoalescedActors.Num() == 0)
+	{
+		return;
+	}
+
+	// Coalesced updates aren't numbered, the client is told it has everything once they're sent
+	TArray<uint8> SerializedData;
+	FMapSyncWriter Ar(SerializedData, StringTable);
+	char Header = UPDATE_HEADER;
+	Ar << Header;
+	uint32 Seq = 0;
+	Ar.SerializeIntPacked(Seq);
+	FName LevelName = GetWorld()->GetFName();
+	Ar << LevelName;
+
+	for (const FName& ActorName : State.CoalescedActors)
+	{
+		AActor* Actor = FindActorByName(ActorName);
+		if (!ShouldSyncActor(Actor))
+		{
+			continue;
+		}
+
+		// The client missed some deltas, so send the whole state
+		FActorState ActorState;
+		CaptureActorState(Actor, ActorState);
+		TArray<uint8> ActorData;
+		FMapSyncWriter ActorAr(ActorData, StringTable);
+		SerializeActorDelta(Actor, ActorState, nullptr, ActorAr);
+
+		char Cmd = UPDATE_CMD;
+		Ar << Cmd;
+		FName Name = ActorName;
+		Ar << Name;
+		uint32 DataSize = ActorData.Num();
+		Ar.SerializeIntPacked(DataSize);
+		Ar.Serialize(ActorData.GetData(), ActorData.Num());
+	}
+	State.CoalescedActors.Empty();
+
+	SendFrame(ClientId, MoveTemp(SerializedData), INDEX_NONE, true);
+}
+
+void FMapSyncEdMode::RenameCoalescedActor(AActor* Actor, const FName& OldName)
+{
+	for (TPair<int32, FClientSendState>& Pair : ClientSendStates)
+	{
+		if (Pair.Value.CoalescedActors.Remove(OldName) > 0)
+		{
+			Pair.Value.CoalescedActors.Add(Actor->GetFName());
+		}
+	}
+}
+
+void FMapSyncEdMode::BuildSnapshot()
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Snapshot);
+
+	Snapshot.Empty();
+
+	// Read every actor on the game thread...
+	TArray<FSnapshotActorCapture> Captures;
+	for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+	{
+		if (ShouldSyncActor(*ActorIt))
+		{
+			CaptureSnapshotActor(*ActorIt, Captures[Captures.AddDefaulted()]);
+		}
+	}
+
+	// ...and encode them on every core
+	TArray<FSnapshotActor> Entries;
+	Entries.SetNum(Captures.Num());
+	ParallelFor(Captures.Num(), [&](int32 i)
+	{
+		EncodeSnapshotActor(Captures[i], Entries[i]);
+	});
+
+	Snapshot.Reserve(Entries.Num());
+	for (int32 i = 0; i < Entries.Num(); i++)
+	{
+		Snapshot.Add(Captures[i].ActorName, MoveTemp(Entries[i]));
+	}
+	UE_LOG(LogMapSync, Log, TEXT("Built a snapshot of %d actors"), Snapshot.Num());
+}
+
+void FMapSyncEdMode::UpdateSnapshotActor(AActor* Actor, const FActorState& State)
+{
+	if (!bBound)
+	{
+		return;
+	}
+
+	FSnapshotActor& Entry = Snapshot.FindOrAdd(Actor->GetFName());
+	if (Entry.Header.Num() == 0)
+	{
+		WriteSnapshotHeader(Actor, Entry.Header);
+	}
+	Entry.State.Reset();
+	for (const TArray<uint8>& SerializerState : State)
+	{
+		Entry.State.Append(SerializerState);
+	}
+}
+
+void FMapSyncEdMode::RenameSnapshotActor(AActor* Actor, const FName& OldName)
+{
+	FSnapshotActor Entry;
+	if (Snapshot.RemoveAndCopyValue(OldName, Entry))
+	{
+		Entry.Header.Reset();
+		WriteSnapshotHeader(Actor, Entry.Header);
+		Snapshot.Add(Actor->GetFName(), MoveTemp(Entry));
+	}
+
+	// Resyncs that didn't stream it yet look it up by its new name. Those that did send it under its old name, and the client gets the rename with the live updates
+	for (FResyncJob& Job : ResyncJobs)
+	{
+		for (int32 ActorIdx = Job.NextActorIdx; ActorIdx < Job.Actors.Num(); ActorIdx++)
+		{
+			if (Job.Actors[ActorIdx] == OldName)
 			{
-				Serializer->MapSyncSerialize(Ar, FoundActor);
+				Job.Actors[ActorIdx] = Actor->GetFName();
+				break;
 			}
 		}
 	}
 }
 
-void FMapSyncEdMode::BuildLastActorsNames()
+void FMapSyncEdMode::WriteSnapshotHeader(AActor* Actor, TArray<uint8>& OutHeader)
+{
+	FMapSyncWriter Ar(OutHeader, StringTable);
+	FName ActorName = Actor->GetFName();
+	Ar << ActorName;
+	SerializeActorClass(Actor, Ar);
+}
+
+void FMapSyncEdMode::AppendSnapshotActor(const FSnapshotActor& Entry, TArray<uint8>& OutData)
+{
+	FMemoryWriter Ar(OutData, true);
+	Ar.Seek(OutData.Num());
+	Ar.Serialize(const_cast<uint8*>(Entry.Header.GetData()), Entry.Header.Num());
+
+	// Actor state, prefixed by its size so that it can be skipped
+	uint32 DataSize = Entry.State.Num();
+	Ar.SerializeIntPacked(DataSize);
+	Ar.Serialize(const_cast<uint8*>(Entry.State.GetData()), Entry.State.Num());
+}
+
+void FMapSyncEdMode::CaptureSnapshotActor(AActor* Actor, FSnapshotActorCapture& OutCapture)
+{
+	INC_DWORD_STAT(STAT_MapSyncActorsSerialized);
+
+	// Capture actor name and creation
+	FMapSyncCaptureWriter HeaderAr(OutCapture.Header);
+	OutCapture.ActorName = Actor->GetFName();
+	FName ActorName = OutCapture.ActorName;
+	HeaderAr << ActorName;
+	SerializeActorClass(Actor, HeaderAr);
+
+	// Capture actor state
+	OutCapture.Serializers = GetActorSerializers(Actor);
+	OutCapture.States.SetNum(OutCapture.Serializers.Num());
+	for (int32 i = 0; i < OutCapture.Serializers.Num(); i++)
+	{
+		OutCapture.Serializers[i]->MapSyncCapture(OutCapture.States[i], Actor);
+	}
+}
+
+void FMapSyncEdMode::EncodeSnapshotActor(const FSnapshotActorCapture& Capture, FSnapshotActor& OutEntry)
+{
+	FMapSyncWriter HeaderAr(OutEntry.Header, StringTable);
+	Capture.Header.Encode(HeaderAr);
+
+	FMapSyncWriter StateAr(OutEntry.State, StringTable);
+	for (int32 i = 0; i < Capture.Serializers.Num(); i++)
+	{
+		Capture.Serializers[i]->MapSyncEncode(StateAr, Capture.States[i]);
+	}
+}
+
+void FMapSyncEdMode::UpdateResyncProgress(bool bFinished)
+{
+	TSharedPtr<SNotificationItem> Notification = ResyncNotification.Pin();
+	if (!Notification.IsValid() && !bFinished)
+	{
+		FNotificationInfo Info(FText::GetEmpty());
+		Info.bFireAndForget = false;
+		Info.bUseThrobber = true;
+		Info.bUseSuccessFailIcons = true;
+		Notification = FSlateNotificationManager::Get().AddNotification(Info);
+		if (Notification.IsValid())
+		{
+			Notification->SetCompletionState(SNotificationItem::CS_Pending);
+		}
+		ResyncNotification = Notification;
+	}
+	if (!Notification.IsValid())
+	{
+		return;
+	}
+
+	if (bFinished)
+	{
+		Notification->SetText(FText::Format(LOCTEXT("ResyncFinished", "MapSync resync finished ({0} actors)"), FText::AsNumber(ResyncActorsApplied)));
+		Notification->SetCompletionState(ResyncActorsApplied >= ResyncActorsTotal ? SNotificationItem::CS_Success : SNotificationItem::CS_Fail);
+		Notification->ExpireAndFadeout();
+		ResyncNotification.Reset();
+	}
+	else
+	{
+		const float Progress = ResyncActorsTotal > 0 ? FMath::Min(1.f, static_cast<float>(ResyncActorsApplied) / ResyncActorsTotal) : 0.f;
+		Notification->SetText(FText::Format(LOCTEXT("ResyncProgress", "MapSync resync: {0} ({1}/{2} actors)"), FText::AsPercent(Progress), FText::AsNumber(ResyncActorsApplied), FText::AsNumber(ResyncActorsTotal)));
+	}
+}
+
+int32 FMapSyncEdMode::DeserializeResync(FMemoryReader& Ar, double EndTime)
+{
+	TGuardValue<bool> ApplyingRemoteChangesGuard(bApplyingRemoteChanges, true);
+
+	int32 ActorCount = 0;
+	while (!Ar.AtEnd())
+	{
+		// Out of time, the caller resumes from here
+		if (EndTime > 0.0 && FPlatformTime::Seconds() >= EndTime)
+		{
+			break;
+		}
+
+		ActorCount++;
+
+		// Deserialize vars
+		FName ActorName; Ar << ActorName;
+		char CreateFlag; Ar << CreateFlag;
+		FName Path; Ar << Path;
+		uint32 DataSize = 0; Ar.SerializeIntPacked(DataSize);
+		const int64 DataEnd = Ar.Tell() + DataSize;
+
+		// Try to find the actor
+		AActor* FoundActor = FindActorByName(ActorName);
+		// If we can't find it, create it
+		if (!FoundActor)
+		{
+			FoundActor = SpawnSyncedActor(ActorName, CreateFlag, Path);
+		}
+
+		if (!FoundActor)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Resync: unable to create actor %s of class %s"), *ActorName.ToString(), *Path.ToString());
+			Ar.Seek(DataEnd);
+			continue;
+		}
+
+		if (!LastActorsNames.Contains(FoundActor))
+		{
+			LastActorsNames.Add(FoundActor, FoundActor->GetFName());
+		}
+
+		// If an actor to modify is selected, unselect it
+		for (FSelectionIterator SelectionIt = GEditor->GetSelectedActorIterator(); SelectionIt; ++SelectionIt)
+		{
+			if (FoundActor == *SelectionIt)
+			{
+				GEditor->GetSelectedActors()->Deselect(FoundActor);
+				break;
+			}
+		}
+
+		// Apply serializers
+		for (UCustomSerializer* Serializer : GetActorSerializers(FoundActor))
+		{
+			Serializer->MapSyncSerialize(Ar, FoundActor);
+		}
+		Ar.Seek(DataEnd);
+
+		// The resync is the state the server has, next local changes are sent against it once applied
+		AppliedActors.Add(FoundActor);
+	}
+
+	return ActorCount;
+}
+
+void FMapSyncEdMode::SerializeActorClass(AActor* Actor, FMemoryWriter& Ar)
+{
+	// Blueprint classes may have to be loaded, native ones are always there. Both are sent as full paths, so that they're never ambiguous
+	char CreateFlag = Actor->GetClass()->GetClass()->IsChildOf<UBlueprintGeneratedClass>() ? BPCLASS_CREATEFLAG : CPPCLASS_CREATEFLAG;
+	Ar << CreateFlag;
+
+	FName Path = *Actor->GetClass()->GetPathName();
+	Ar << Path;
+}
+
+UClass* FMapSyncEdMode::ResolveActorClass(char CreateFlag, const FName& ClassPath)
+{
+	if (TWeakObjectPtr<UClass>* CachedClass = ResolvedClasses.Find(ClassPath))
+	{
+		UClass* Class = CachedClass->Get();
+		if (Class && !Class->HasAnyClassFlags(CLASS_NewerVersionExists))
+		{
+			return Class;
+		}
+	}
+
+	UClass* Class = nullptr;
+	if (CreateFlag == BPCLASS_CREATEFLAG)
+	{
+		Class = LoadClass<AActor>(nullptr, *ClassPath.ToString());
+	}
+	else if (CreateFlag == CPPCLASS_CREATEFLAG)
+	{
+		Class = FindObject<UClass>(nullptr, *ClassPath.ToString());
+	}
+
+	if (!Class || !Class->IsChildOf(AActor::StaticClass()))
+	{
+		UE_LOG(LogMapSync, Warning, TEXT("Unable to find actor class %s"), *ClassPath.ToString());
+		return nullptr;
+	}
+
+	ResolvedClasses.Add(ClassPath, Class);
+	return Class;
+}
+
+AActor* FMapSyncEdMode::SpawnSyncedActor(const FName& ActorName, char CreateFlag, const FName& ClassPath)
+{
+	UClass* Class = ResolveActorClass(CreateFlag, ClassPath);
+	if (!Class)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters ASP;
+	ASP.Name = ActorName;
+	ASP.NameMode = FActorSpawnParameters::ESpawnActorNameMode::Required_ErrorAndReturnNull; // A name already taken isn't worth crashing the editor
+	return GetWorld()->SpawnActor<AActor>(Class, ASP);
+}
+
+void FMapSyncEdMode::BuildLastActorsNames()
+{
+	LastActorsNames.Empty();
+
+	// Init LastActorMod -> Set all actors but not their descriptions, to avoid memory usage
+	// Descriptions will be set as soon as they are selected
+	for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+	{
+		if (ActorIt->IsA(ULevel::StaticClass()) || ActorIt->IsA(ALevelScriptActor::StaticClass()))
+		{
+			continue;
+		}
+
+		LastActorsNames.Add(*ActorIt, ActorIt->GetFName());
+	}
+	LastActorsData.Empty();
+	DirtyActors.Empty();
+	MovingActors.Empty();
+	PendingRemovedActors.Empty();
+}
+
+void FMapSyncEdMode::BindChangeDelegates()
+{
+	UnbindChangeDelegates();
+
+	ChangeDelegateHandles.Add(FCoreUObjectDelegates::OnObjectPropertyChanged.AddRaw(this, &FMapSyncEdMode::OnObjectPropertyChanged));
+	ChangeDelegateHandles.Add(FCoreUObjectDelegates::OnObjectTransacted.AddRaw(this, &FMapSyncEdMode::OnObjectTransacted));
+	ChangeDelegateHandles.Add(FCoreDelegates::OnActorLabelChanged.AddRaw(this, &FMapSyncEdMode::OnActorLabelChanged));
+	ChangeDelegateHandles.Add(GEngine->OnActorMoved().AddRaw(this, &FMapSyncEdMode::OnActorMoved));
+	ChangeDelegateHandles.Add(GEngine->OnLevelActorAdded().AddRaw(this, &FMapSyncEdMode::OnLevelActorAdded));
+	ChangeDelegateHandles.Add(GEngine->OnLevelActorDeleted().AddRaw(this, &FMapSyncEdMode::OnLevelActorDeleted));
+	ChangeDelegateHandles.Add(GEditor->OnBeginObjectMovement().AddRaw(this, &FMapSyncEdMode::OnBeginObjectMovement));
+	ChangeDelegateHandles.Add(GEditor->OnEndObjectMovement().AddRaw(this, &FMapSyncEdMode::OnEndObjectMovement));
+}
+
+void FMapSyncEdMode::UnbindChangeDelegates()
+{
+	if (ChangeDelegateHandles.Num() == 0)
+	{
+		return;
+	}
+
+	// Same order as in BindChangeDelegates
+	FCoreUObjectDelegates::OnObjectPropertyChanged.Remove(ChangeDelegateHandles[0]);
+	FCoreUObjectDelegates::OnObjectTransacted.Remove(ChangeDelegateHandles[1]);
+	FCoreDelegates::OnActorLabelChanged.Remove(ChangeDelegateHandles[2]);
+	if (GEngine)
+	{
+		GEngine->OnActorMoved().Remove(ChangeDelegateHandles[3]);
+		GEngine->OnLevelActorAdded().Remove(ChangeDelegateHandles[4]);
+		GEngine->OnLevelActorDeleted().Remove(ChangeDelegateHandles[5]);
+	}
+	if (GEditor)
+	{
+		GEditor->OnBeginObjectMovement().Remove(ChangeDelegateHandles[6]);
+		GEditor->OnEndObjectMovement().Remove(ChangeDelegateHandles[7]);
+	}
+	ChangeDelegateHandles.Empty();
+}
+
+bool FMapSyncEdMode::ShouldSyncActor(AActor* Actor) const
+{
+	return Actor && !Actor->IsPendingKill() && !Actor->HasAnyFlags(RF_Transient) && Actor->GetWorld() == GetWorld() && !Actor->IsA(ALevelScriptActor::StaticClass());
+}
+
+void FMapSyncEdMode::MarkActorDirty(AActor* Actor)
+{
+	if (!bApplyingRemoteChanges && bActorInit && ShouldSyncActor(Actor))
+	{
+		DirtyActors.Add(Actor);
+	}
+}
+
+void FMapSyncEdMode::OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& PropertyChangedEvent)
+{
+	// Properties of components (mesh, materials, light color...) dirty their owning actor
+	if (UActorComponent* Component = Cast<UActorComponent>(Object))
+	{
+		MarkActorDirty(Component->GetOwner());
+	}
+	else
+	{
+		MarkActorDirty(Cast<AActor>(Object));
+	}
+}
+
+void FMapSyncEdMode::OnObjectTransacted(UObject* Object, const FTransactionObjectEvent& TransactionEvent)
+{
+	// Covers undo/redo, and any other change made through a transaction
+	if (UActorComponent* Component = Cast<UActorComponent>(Object))
+	{
+		MarkActorDirty(Component->GetOwner());
+	}
+	else
+	{
+		MarkActorDirty(Cast<AActor>(Object));
+	}
+}
+
+void FMapSyncEdMode::OnActorMoved(AActor* Actor)
+{
+	MarkActorDirty(Actor);
+}
+
+void FMapSyncEdMode::OnActorLabelChanged(AActor* Actor)
+{
+	MarkActorDirty(Actor);
+}
+
+void FMapSyncEdMode::OnLevelActorAdded(AActor* Actor)
+{
+	// Unknown dirty actors are sent as created
+	MarkActorDirty(Actor);
+}
+
+void FMapSyncEdMode::OnLevelActorDeleted(AActor* Actor)
+{
+	if (bApplyingRemoteChanges || !bActorInit || !Actor)
+	{
+		return;
+	}
+
+	FName LastName;
+	if (LastActorsNames.RemoveAndCopyValue(Actor, LastName))
+	{
+		PendingRemovedActors.Add(LastName);
+	}
+	LastActorsData.Remove(Actor);
+	DirtyActors.Remove(Actor);
+	MovingActors.Remove(Actor);
+}
+
+void FMapSyncEdMode::OnBeginObjectMovement(UObject& Object)
+{
+	AActor* Actor = Cast<AActor>(&Object);
+	if (!bApplyingRemoteChanges && bActorInit && ShouldSyncActor(Actor))
+	{
+		MovingActors.Add(Actor);
+	}
+}
+
+void FMapSyncEdMode::OnEndObjectMovement(UObject& Object)
+{
+	AActor* Actor = Cast<AActor>(&Object);
+	MovingActors.Remove(Actor);
+
+	// Send the final position
+	MarkActorDirty(Actor);
+}
+
+void FMapSyncEdMode::BuildActorsByName()
+{
+	ClearActorsByName();
+
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return;
+	}
+	IndexedWorld = World;
+
+	for (TActorIterator<AActor> ActorIt(World); ActorIt; ++ActorIt)
+	{
+		ActorsByName.Add(ActorIt->GetFName(), *ActorIt);
+	}
+
+	// Keep the index current: actors spawned by us or by the editor, actors added through the level editor, and deleted actors
+	ActorSpawnedHandle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateRaw(this, &FMapSyncEdMode::OnIndexedActorAdded));
+	LevelActorAddedHandle = GEngine->OnLevelActorAdded().AddRaw(this, &FMapSyncEdMode::OnIndexedActorAdded);
+	LevelActorDeletedHandle = GEngine->OnLevelActorDeleted().AddRaw(this, &FMapSyncEdMode::OnIndexedActorRemoved);
+}
+
+void FMapSyncEdMode::ClearActorsByName()
+{
+	if (IndexedWorld.IsValid())
+	{
+		IndexedWorld->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+	}
+	if (GEngine)
+	{
+		GEngine->OnLevelActorAdded().Remove(LevelActorAddedHandle);
+		GEngine->OnLevelActorDeleted().Remove(LevelActorDeletedHandle);
+	}
+
+	ActorSpawnedHandle.Reset();
+	LevelActorAddedHandle.Reset();
+	LevelActorDeletedHandle.Reset();
+	IndexedWorld.Reset();
+	ActorsByName.Empty();
+}
+
+void FMapSyncEdMode::OnIndexedActorAdded(AActor* Actor)
+{
+	if (Actor && Actor->GetWorld() == IndexedWorld.Get())
+	{
+		ActorsByName.Add(Actor->GetFName(), Actor);
+	}
+}
+
+void FMapSyncEdMode::OnIndexedActorRemoved(AActor* Actor)
+{
+	if (!Actor)
+	{
+		return;
+	}
+
+	// Only remove the entry if it still points to this actor, the name may have been reused since
+	TWeakObjectPtr<AActor>* Found = ActorsByName.Find(Actor->GetFName());
+	if (Found && (!Found->IsValid() || Found->Get() == Actor))
+	{
+		ActorsByName.Remove(Actor->GetFName());
+	}
+}
+
+void FMapSyncEdMode::OnIndexedActorRenamed(AActor* Actor, const FName& OldName)
 {
-	LastActorsNames.Empty();
+	TWeakObjectPtr<AActor>* Found = ActorsByName.Find(OldName);
+	if (Found && (!Found->IsValid() || Found->Get() == Actor))
+	{
+		ActorsByName.Remove(OldName);
+	}
+	ActorsByName.Add(Actor->GetFName(), Actor);
+}
 
-	// Init LastActorMod -> Set all actors but not their descriptions, to avoid memory usage
-	// Descriptions will be set as soon as they are selected
-	for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+AActor* FMapSyncEdMode::FindActorByName(const FName& ActorName)
+{
+	if (TWeakObjectPtr<AActor>* Found = ActorsByName.Find(ActorName))
 	{
-		if (ActorIt->IsA(ULevel::StaticClass()) || ActorIt->IsA(ALevelScriptActor::StaticClass()))
+		AActor* Actor = Found->Get();
+		if (Actor && !Actor->IsPendingKill() && Actor->GetFName() == ActorName)
 		{
-			continue;
+			return Actor;
 		}
 
-		LastActorsNames.Add(TPairInitializer<AActor*, FString>(*ActorIt, ActorIt->GetFName().ToString()));
+		// Stale entry: the actor was garbage collected or renamed without us noticing
+		ActorsByName.Remove(ActorName);
+	}
+
+	// Actors are outered to their level, so the object hash gives us an O(1) fallback
+	UWorld* World = GetWorld();
+	if (!World)
+	{
+		return nullptr;
+	}
+	for (ULevel* Level : World->GetLevels())
+	{
+		AActor* Actor = Cast<AActor>(StaticFindObjectFast(AActor::StaticClass(), Level, ActorName));
+		if (Actor && !Actor->IsPendingKill())
+		{
+			ActorsByName.Add(ActorName, Actor);
+			return Actor;
+		}
 	}
+
+	return nullptr;
 }
 
 void FMapSyncEdMode::BuildCustomSerializers()
 {
 	CustomSerializers.Empty();
+	SerializerChains.Empty();
+	BindSerializerDelegates();
 
 	for (TObjectIterator<UClass> It; It; ++It)
 	{
-		if (It->IsChildOf(UCustomSerializer::StaticClass()))
+		// Classes replaced by a hot reload or a blueprint compilation are left behind until GC, skip them
+		if (It->IsChildOf(UCustomSerializer::StaticClass()) && !It->HasAnyClassFlags(CLASS_NewerVersionExists))
 		{
 			UCustomSerializer* CS = const_cast<UCustomSerializer*>(GetDefault<UCustomSerializer>(*It));
 			CustomSerializers.Add(CS);
@@ -521,191 +1758,421 @@ void FMapSyncEdMode::BuildCustomSerializers()
 	}
 
 	// WTF UE4?! Why is it deferencing pointers?!
-	CustomSerializers.Sort([](UCustomSerializer& First, UCustomSerializer& Second) { return First.GetFName().FastLess(Second.GetFName()); });
+	// Serializers are flagged by their index in updates, so the order must be the same in every editor, which FName::FastLess doesn't guarantee
+	CustomSerializers.Sort([](UCustomSerializer& First, UCustomSerializer& Second) { return First.GetName() < Second.GetName(); });
+}
+
+const TArray<UCustomSerializer*>& FMapSyncEdMode::GetActorSerializers(AActor* Actor)
+{
+	UClass* Class = Actor->GetClass();
+	if (const TArray<UCustomSerializer*>* Chain = SerializerChains.Find(Class))
+	{
+		return *Chain;
+	}
+
+	// First actor of this class, find which serializers apply to it
+	TArray<UCustomSerializer*>& Chain = SerializerChains.Add(Class);
+	for (UCustomSerializer* Serializer : CustomSerializers)
+	{
+		if (Class->IsChildOf(Serializer->GetSupportedClass()))
+		{
+			if (Chain.Num() == MAX_ACTOR_SERIALIZERS)
+			{
+				UE_LOG(LogMapSync, Warning, TEXT("More than %d serializers apply to %s, the others are ignored"), MAX_ACTOR_SERIALIZERS, *Class->GetName());
+				break;
+			}
+			Chain.Add(Serializer);
+		}
+	}
+	return Chain;
+}
+
+void FMapSyncEdMode::BindSerializerDelegates()
+{
+	if (SerializerDelegateHandles.Num() > 0)
+	{
+		return;
+	}
+
+	// New native classes may come with a module, new blueprint ones with a compilation, and hot reload replaces the existing ones
+	SerializerDelegateHandles.Add(FCoreUObjectDelegates::CompiledInUObjectsRegisteredDelegate.AddRaw(this, &FMapSyncEdMode::OnCompiledInUObjectsRegistered));
+	SerializerDelegateHandles.Add(GEditor->OnBlueprintCompiled().AddRaw(this, &FMapSyncEdMode::OnClassesChanged));
+	IHotReloadInterface* HotReload = IHotReloadInterface::GetPtr();
+	SerializerDelegateHandles.Add(HotReload ? HotReload->OnHotReload().AddRaw(this, &FMapSyncEdMode::OnHotReload) : FDelegateHandle());
+}
+
+void FMapSyncEdMode::UnbindSerializerDelegates()
+{
+	if (SerializerDelegateHandles.Num() == 0)
+	{
+		return;
+	}
+
+	// Same order as in BindSerializerDelegates
+	FCoreUObjectDelegates::CompiledInUObjectsRegisteredDelegate.Remove(SerializerDelegateHandles[0]);
+	if (GEditor)
+	{
+		GEditor->OnBlueprintCompiled().Remove(SerializerDelegateHandles[1]);
+	}
+	if (IHotReloadInterface* HotReload = IHotReloadInterface::GetPtr())
+	{
+		HotReload->OnHotReload().Remove(SerializerDelegateHandles[2]);
+	}
+	SerializerDelegateHandles.Empty();
+}
+
+void FMapSyncEdMode::OnClassesChanged()
+{
+	ResolvedClasses.Empty();
+	BuildCustomSerializers();
+}
+
+void FMapSyncEdMode::OnCompiledInUObjectsRegistered(FName Package)
+{
+	OnClassesChanged();
+}
+
+void FMapSyncEdMode::OnHotReload(bool bWasTriggeredAutomatically)
+{
+	OnClassesChanged();
 }
 
-bool FMapSyncEdMode::SerializeAllActorsChange(FMemoryWriter& Ar)
+void FMapSyncEdMode::CaptureActorState(AActor* Actor, FActorState& OutState)
 {
+	INC_DWORD_STAT(STAT_MapSyncActorsSerialized);
+
+	const TArray<UCustomSerializer*>& Serializers = GetActorSerializers(Actor);
+
+	OutState.Reset();
+	OutState.SetNum(Serializers.Num());
+	for (int32 i = 0; i < Serializers.Num(); i++)
+	{
+		FMapSyncWriter StateAr(OutState[i], StringTable);
+		Serializers[i]->MapSyncSerialize(StateAr, Actor);
+	}
+}
+
+bool FMapSyncEdMode::SerializeAllActorsChange(FMemoryWriter& Ar, FUpdateSummary* OutSummary)
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(DetectChanges);
+
+	// Actors being dragged change on every tick, without any delegate telling us. Only send them as often as the link keeps up, and as their change is worth it
+	if (MovingActors.Num() > 0)
+	{
+		UpdateDragSendInterval();
+		const double Now = FPlatformTime::Seconds();
+		const float Elapsed = Now - LastDragSendTime;
+		if (Elapsed >= DragSendInterval)
+		{
+			// Nothing to send while the gizmo is held still, and slow drags look the same to peers with fewer updates
+			const float ChangeRate = GetDragChangeRate(Elapsed);
+			if (ChangeRate > 0.f && (ChangeRate >= DRAG_SLOW_CHANGE_RATE || Elapsed >= DRAG_SLOW_SEND_INTERVAL))
+			{
+				LastDragSendTime = Now;
+				for (auto& MovingActor : MovingActors)
+				{
+					DirtyActors.Add(MovingActor);
+					if (MovingActor.IsValid())
+					{
+						DragSentTransforms.Add(MovingActor, MovingActor->GetActorTransform());
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		DragSentTransforms.Empty();
+	}
+
+	// Nothing changed since last tick, don't even build the message
+	if (DirtyActors.Num() == 0 && PendingRemovedActors.Num() == 0)
+	{
+		return false;
+	}
+
 	// Add level name at the beginning, so each client knows wether the data sent it for his level or not
-	FString LevelName = GetWorld()->GetFName().ToString();
+	FName LevelName = GetWorld()->GetFName();
 	Ar << LevelName;
 
 	bool ToReturn = false;
 
-	// Handle renamed actors
-	for (auto& it : LastActorsNames)
+	// Handle deleted actors
+	for (FName& RemovedName : PendingRemovedActors)
+	{
+		Snapshot.Remove(RemovedName);
+
+		char Cmd = REMOVE_CMD;
+		Ar << Cmd;
+		Ar << RemovedName;
+		INC_DWORD_STAT(STAT_MapSyncRemoveCommands);
+		ToReturn = true;
+		if (OutSummary) OutSummary->bCoalescable = false;
+	}
+	PendingRemovedActors.Empty();
+
+	// Handle created and renamed actors
+	for (auto& DirtyActor : DirtyActors)
 	{
-		AActor* TheActor = it.Key;
-		if (!TheActor || TheActor->IsPendingKill())
+		AActor* TheActor = DirtyActor.Get();
+		if (!ShouldSyncActor(TheActor))
 		{
 			continue;
 		}
 
-		if (TheActor->GetFName().ToString() != it.Value)
+		FName* LastName = LastActorsNames.Find(TheActor);
+
+		// If the actor is not known yet, it was just created
+		if (!LastName)
 		{
+			LastActorsNames.Add(TheActor, TheActor->GetFName());
+
+			char Cmd = CREATE_CMD;
+			Ar << Cmd;
+			FName ActorName = TheActor->GetFName();
+			Ar << ActorName;
+			INC_DWORD_STAT(STAT_MapSyncCreateCommands);
+
+			SerializeActorClass(TheActor, Ar);
+			ToReturn = true;
+			if (OutSummary) OutSummary->bCoalescable = false;
+			// No need to serialize the actor here, it will be serialized later in the function
+		}
+		else if (TheActor->GetFName() != *LastName)
+		{
+			OnIndexedActorRenamed(TheActor, *LastName);
+
 			char Cmd = RENAME_CMD;
 			Ar << Cmd;
-			FString OldName = it.Value;
+			FName OldName = *LastName;
 			Ar << OldName;
-			FString NewName = TheActor->GetFName().ToString();
+			FName NewName = TheActor->GetFName();
 			Ar << NewName;
+			INC_DWORD_STAT(STAT_MapSyncRenameCommands);
 			ToReturn = true;
+			if (OutSummary) OutSummary->bCoalescable = false;
 
-			it.Value = TheActor->GetFName().ToString();
+			RenameSnapshotActor(TheActor, *LastName);
+			RenameCoalescedActor(TheActor, *LastName);
+			*LastName = TheActor->GetFName();
 		}
 	}
 
-	// Handle deleted actors
-	for (int32 LActorIdx = LastActorsNames.Num() - 1; LActorIdx >= 0; LActorIdx--)
+	// Handle actor modifications
+	for (auto& DirtyActor : DirtyActors)
 	{
-		AActor* LActor = LastActorsNames[LActorIdx].Key;
-		if (!LActor)
+		AActor* ActorToMod = DirtyActor.Get();
+		if (!ShouldSyncActor(ActorToMod))
 		{
-			LastActorsNames.RemoveAt(LActorIdx);
+			continue;
 		}
-		else if (LActor->IsPendingKill())
-		{
-			char Cmd = REMOVE_CMD;
-			Ar << Cmd;
-			FString Name = LActor->GetFName().ToString();
-			Ar << Name;
-			ToReturn = true;
 
-			LastActorsNames.RemoveAt(LActorIdx);
+		// First, see if what we'll send isn't a duplicate
+		FActorState State;
+		CaptureActorState(ActorToMod, State);
+
+		// Find the previous state that was agreed on for this actor. If it's the same, don't send anything
+		FActorState* LastState = LastActorsData.Find(ActorToMod);
+		if (LastState && *LastState == State)
+		{
+			continue;
 		}
+
+		// Only send what changed since then
+		TArray<uint8> TempActorArray;
+		FMapSyncWriter TempAr(TempActorArray, StringTable);
+		SerializeActorDelta(ActorToMod, State, LastState, TempAr);
+
+		// Send the update
+		char Cmd = UPDATE_CMD;
+		Ar << Cmd;
+		FName Name = ActorToMod->GetFName();
+		Ar << Name;
+		INC_DWORD_STAT(STAT_MapSyncUpdateCommands);
+		ToReturn = true;
+		if (OutSummary) OutSummary->UpdatedActors.Add(Name);
+		uint32 DataSize = TempActorArray.Num();
+		Ar.SerializeIntPacked(DataSize);
+		Ar.Serialize(TempActorArray.GetData(), TempActorArray.Num());
+
+		UpdateSnapshotActor(ActorToMod, State);
+		LastActorsData.Add(ActorToMod, MoveTemp(State));
 	}
+	DirtyActors.Empty();
+
+	return ToReturn;
+}
 
-	// Handle created actors
-	for (FSelectionIterator SelectionIt = GEditor->GetSelectedActorIterator(); SelectionIt; ++SelectionIt)
+float FMapSyncEdMode::GetDragChangeRate(float Elapsed) const
+{
+	float MaxChange = 0.f;
+	for (const TWeakObjectPtr<AActor>& MovingActor : MovingActors)
 	{
-		AActor* SelectedActor = Cast<AActor>(*SelectionIt);
-		if (!SelectedActor || SelectedActor->IsPendingKill())
+		if (!MovingActor.IsValid())
 		{
 			continue;
 		}
 
-		bool bFound = false;
-		for (int32 LActorIdx = 0; LActorIdx < LastActorsNames.Num(); LActorIdx++)
+		// Not sent since the drag started
+		const FTransform* SentTransform = DragSentTransforms.Find(MovingActor);
+		if (!SentTransform)
 		{
-			AActor* LActor = LastActorsNames[LActorIdx].Key;
-			if (!LActor || LActor->IsPendingKill())
-			{
-				continue;
-			}
-
-			if (LActor == SelectedActor)
-			{
-				bFound = true;
-				break;
-			}
+			return MAX_flt;
 		}
 
-		// If the actor was not found in the LastActorsNames array, it was just created
-		if (!bFound)
+		const FTransform Transform = MovingActor->GetActorTransform();
+		MaxChange = FMath::Max(MaxChange, FVector::Dist(Transform.GetLocation(), SentTransform->GetLocation()));
+		MaxChange = FMath::Max(MaxChange, FMath::RadiansToDegrees(Transform.GetRotation().AngularDistance(SentTransform->GetRotation())));
+		MaxChange = FMath::Max(MaxChange, (Transform.GetScale3D() - SentTransform->GetScale3D()).GetAbsMax() * 100.f);
+	}
+	return MaxChange > KINDA_SMALL_NUMBER ? MaxChange / FMath::Max(Elapsed, SMALL_NUMBER) : 0.f;
+}
+
+void FMapSyncEdMode::UpdateDragSendInterval()
+{
+	// What is still waiting to be sent to the slowest peer. Lagging clients get coalesced updates anyway
+	int64 QueuedBytes = 0;
+	if (bConnectedToServer)
+	{
+		QueuedBytes = Network->GetQueuedBytes(ServerPeerId);
+	}
+	for (int32 ClientId : Clients)
+	{
+		const FClientSendState* State = ClientSendStates.Find(ClientId);
+		if (!State || !State->bLagging)
 		{
-			LastActorsNames.Add(TPairInitializer<AActor*, FString>(SelectedActor, SelectedActor->GetFName().ToString()));
+			QueuedBytes = FMath::Max(QueuedBytes, Network->GetQueuedBytes(ClientId));
+		}
+	}
 
-			char Cmd = CREATE_CMD;
-			Ar << Cmd;
-			FString ActorName = SelectionIt->GetFName().ToString();
-			Ar << ActorName;
+	// Back off quickly while the link fills up, come back to every tick once it drained
+	if (QueuedBytes > DRAG_QUEUE_THRESHOLD)
+	{
+		DragSendInterval = FMath::Min(FMath::Max(DragSendInterval * 2.f, DRAG_MIN_BACKOFF_INTERVAL), DRAG_MAX_SEND_INTERVAL);
+	}
+	else if (QueuedBytes < DRAG_QUEUE_THRESHOLD / 4)
+	{
+		DragSendInterval = DragSendInterval / 2.f < DRAG_MIN_BACKOFF_INTERVAL ? 0.f : DragSendInterval / 2.f;
+	}
+}
 
-			// If is a BP class
-			if (SelectionIt->GetClass()->GetClass()->IsChildOf<UBlueprintGeneratedClass>())
-			{
-				char CreateFlag = BPCLASS_CREATEFLAG;
-				Ar << CreateFlag;
+void FMapSyncEdMode::SerializeOneActorMod(AActor* TheActor, FMemoryWriter& Ar)
+{
+	if (!TheActor) return;
+	const TArray<UCustomSerializer*>& Serializers = GetActorSerializers(TheActor);
+	for (UCustomSerializer* Serializer : Serializers)
+	{
+		Serializer->MapSyncSerialize(Ar, TheActor);
+	}
+}
 
-				FString Path = SelectionIt->GetClass()->GetPathName();
-				Ar << Path;
-			}
-			// If is a CPP class
-			else
-			{
-				char CreateFlag = CPPCLASS_CREATEFLAG;
-				Ar << CreateFlag;
+void FMapSyncEdMode::SerializeActorDelta(AActor* TheActor, const FActorState& State, const FActorState* LastState, FMemoryWriter& Ar)
+{
+	const TArray<UCustomSerializer*>& Serializers = GetActorSerializers(TheActor);
 
-				FString ClassName = SelectionIt->GetClass()->GetFName().ToString();
-				Ar << ClassName;
-			}
-			ToReturn = true;
-			// No need to serialize the actor here, it will be serialized later in the function
+	// Flag the serializers whose state changed
+	uint32 SerializerMask = 0;
+	for (int32 i = 0; i < Serializers.Num(); i++)
+	{
+		if (!LastState || !LastState->IsValidIndex(i) || (*LastState)[i] != State[i])
+		{
+			SerializerMask |= 1u << i;
 		}
 	}
+	Ar.SerializeIntPacked(SerializerMask);
 
-	// Handle actor modifications
-	for (FSelectionIterator SelectionIt = GEditor->GetSelectedActorIterator(); SelectionIt; ++SelectionIt)
+	// Each of them then writes its changed fields, comparing against its part of the last state
+	for (int32 i = 0; i < Serializers.Num(); i++)
 	{
-		AActor* ActorToMod = Cast<AActor>(*SelectionIt); if (!ActorToMod) continue;
-
-		// First, see if what we'll send isn't a duplicate
-		// Serialize the actor into a temporary array
-		TArray<uint8> TempActorArray;
-		FMemoryWriter TempAr(TempActorArray, true);
-		SerializeOneActorMod(ActorToMod, TempAr);
+		if (!(SerializerMask & (1u << i)))
+		{
+			continue;
+		}
 
-		// Find the previous data that were sent for this actor. If they don't exist, create them
-		TPair<AActor*, TArray<uint8>>* FoundPair = LastActorsData.FindByPredicate([&](TPair<AActor*, TArray<uint8>>& TempPair)
+		if (LastState && LastState->IsValidIndex(i))
 		{
-			return TempPair.Key == ActorToMod;
-		});
-		if (FoundPair == nullptr)
+			FMapSyncReader BaselineAr((*LastState)[i], StringTable);
+			Serializers[i]->MapSyncSerializeDelta(Ar, &BaselineAr, TheActor);
+		}
+		else
 		{
-			LastActorsData.Add(TPairInitializer<AActor*, TArray<uint8>>(ActorToMod, {}));
-			FoundPair = &LastActorsData.Last();
+			Serializers[i]->MapSyncSerializeDelta(Ar, nullptr, TheActor);
 		}
+	}
+}
+
+void FMapSyncEdMode::DeserializeActorDelta(AActor* TheActor, FMemoryReader& Ar)
+{
+	const TArray<UCustomSerializer*>& Serializers = GetActorSerializers(TheActor);
 
-		// If the fount data were the same, don't send them
-		if (FoundPair->Value == TempActorArray)
+	uint32 SerializerMask = 0;
+	Ar.SerializeIntPacked(SerializerMask);
+	for (int32 i = 0; i < Serializers.Num(); i++)
+	{
+		if (SerializerMask & (1u << i))
 		{
-			continue;
+			Serializers[i]->MapSyncSerializeDelta(Ar, nullptr, TheActor);
 		}
-		FoundPair->Value = TempActorArray;
-
-		// Send the update
-		char Cmd = UPDATE_CMD;
-		Ar << Cmd;
-		FString Name = SelectionIt->GetFName().ToString();
-		Ar << Name;
-		ToReturn = true;
-		SerializeOneActorMod(ActorToMod, Ar);
 	}
 
-	return ToReturn;
+	// What we'll have once applied is what every peer has, next local changes are sent against it
+	AppliedActors.Add(TheActor);
 }
 
-void FMapSyncEdMode::SerializeOneActorMod(AActor* TheActor, FMemoryWriter& Ar)
+void FMapSyncEdMode::FlushRemoteChanges()
 {
-	if (!TheActor) return;
-	for (auto& Serializer : CustomSerializers)
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Apply);
+
+	TGuardValue<bool> ApplyingRemoteChangesGuard(bApplyingRemoteChanges, true);
+
+	// Load the assets the received actors need, all at once. They're applied with a later batch, once loaded
+	FMapSyncAssetLoader::Get().FlushRequests();
+
+	// Apply the whole batch, including assets that finished loading since last tick. Their actors' agreed state then includes them
+	FMapSyncApplyBatch::Get().Flush(GetWorld(), AppliedActors);
+
+	for (const TWeakObjectPtr<AActor>& AppliedActor : AppliedActors)
 	{
-		if (TheActor->GetClass()->IsChildOf(Serializer->GetSupportedClass()))
+		AActor* Actor = AppliedActor.Get();
+		if (Actor && !Actor->IsPendingKill())
 		{
-			Serializer->MapSyncSerialize(Ar, TheActor);
+			FActorState& LastState = LastActorsData.FindOrAdd(Actor);
+			CaptureActorState(Actor, LastState);
+			UpdateSnapshotActor(Actor, LastState);
 		}
 	}
+	AppliedActors.Empty();
 }
 
-void FMapSyncEdMode::DeserializeAllActorsChange(FMemoryReader& Ar)
+bool FMapSyncEdMode::DeserializeAllActorsChange(FMemoryReader& Ar, FUpdateSummary* OutSummary, double EndTime)
 {
 	// Check that the target level is the one we're editing
-	FString LevelName;
+	FName LevelName;
 	Ar << LevelName;
-	if (LevelName != GetWorld()->GetFName().ToString())
+	if (LevelName != GetWorld()->GetFName())
 	{
+		if (OutSummary) OutSummary->bCoalescable = false;
 		// GEngine->AddOnScreenDebugMessage(-1, 500.f, FColor::Red, "EXIT " + GetWorld()->GetFName().ToString());
-		return;
+		return true;
 	}
 
-	if (Ar.AtEnd())
-	{
-		return;
-	}
+	return DeserializeActorCommands(Ar, OutSummary, EndTime);
+}
+
+bool FMapSyncEdMode::DeserializeActorCommands(FMemoryReader& Ar, FUpdateSummary* OutSummary, double EndTime)
+{
+	TGuardValue<bool> ApplyingRemoteChangesGuard(bApplyingRemoteChanges, true);
 
 	char NextCmd = '\0';
 	bool bShouldContinue = true;
 	while(!Ar.AtEnd() && bShouldContinue)
 	{
+		// Out of time, the caller resumes from here
+		if (EndTime > 0.0 && FPlatformTime::Seconds() >= EndTime)
+		{
+			return false;
+		}
+
 		Ar << NextCmd;
 		bShouldContinue = false;
 
@@ -713,28 +2180,23 @@ void FMapSyncEdMode::DeserializeAllActorsChange(FMemoryReader& Ar)
 		if (NextCmd == RENAME_CMD)
 		{
 			bShouldContinue = true;
+			INC_DWORD_STAT(STAT_MapSyncRenameCommands);
+			if (OutSummary) OutSummary->bCoalescable = false;
 
 			FName OldName;
 			Ar << OldName;
 			FName NewName;
 			Ar << NewName;
 
-			for (auto& ActorNameIt : LastActorsNames)
+			AActor* ActorToRename = FindActorByName(OldName);
+			if (ActorToRename)
 			{
-				if (ActorNameIt.Key->GetFName() == OldName)
-				{
 #if 0
-					ActorNameIt.Key->Rename(*NewName.ToString());
-					ActorNameIt.Value = NewName;
+				ActorToRename->Rename(*NewName.ToString());
+				LastActorsNames.Add(ActorToRename, NewName);
 #endif
-					break;
-				}
 			}
 
-			if (Ar.AtEnd())
-			{
-				return;
-			}
 			continue;
 		}
 
@@ -742,42 +2204,24 @@ void FMapSyncEdMode::DeserializeAllActorsChange(FMemoryReader& Ar)
 		if (NextCmd == REMOVE_CMD)
 		{
 			bShouldContinue = true;
+			INC_DWORD_STAT(STAT_MapSyncRemoveCommands);
+			if (OutSummary) OutSummary->bCoalescable = false;
 
-			FString ActorName;
+			FName ActorName;
 			Ar << ActorName;
 
-			for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+			AActor* ActorToRemove = FindActorByName(ActorName);
+			if (ActorToRemove)
 			{
-				if (ActorIt->GetFName().ToString() == ActorName)
-				{
-					// Remove the actor in LastActorsData
-					for (int32 i = 0; i < LastActorsData.Num(); i++)
-					{
-						if (LastActorsData[i].Key == *ActorIt)
-						{
-							LastActorsData.RemoveAtSwap(i);
-							break;
-						}
-					}
-					// Remove the actor in LastActorsNames
-					for (int32 i = 0; i < LastActorsNames.Num(); i++)
-					{
-						if (LastActorsNames[i].Key == *ActorIt)
-						{
-							LastActorsNames.RemoveAtSwap(i);
-							break;
-						}
-					}
-					// Actually destroy the actor
-					ActorIt->Destroy();
-					break;
-				}
+				// Remove the actor in LastActorsData, LastActorsNames and the snapshot
+				Snapshot.Remove(ActorName);
+				LastActorsData.Remove(ActorToRemove);
+				LastActorsNames.Remove(ActorToRemove);
+				DirtyActors.Remove(ActorToRemove);
+				// Actually destroy the actor, the index is updated by the deleted delegate
+				ActorToRemove->Destroy();
 			}
 
-			if (Ar.AtEnd())
-			{
-				return;
-			}
 			continue;
 		}
 
@@ -785,49 +2229,29 @@ void FMapSyncEdMode::DeserializeAllActorsChange(FMemoryReader& Ar)
 		if (NextCmd == CREATE_CMD)
 		{
 			bShouldContinue = true;
+			INC_DWORD_STAT(STAT_MapSyncCreateCommands);
+			if (OutSummary) OutSummary->bCoalescable = false;
 
-			FString ActorName;
+			FName ActorName;
 			Ar << ActorName;
 			
 			char CreateFlag;
 			Ar << CreateFlag;
+			FName Path;
+			Ar << Path;
 
-			if (CreateFlag == BPCLASS_CREATEFLAG)
-			{
-				FString Path;
-				Ar << Path;
-
-				UClass* FoundClass = LoadClass<AActor>(nullptr, *Path);
-				if (FoundClass)
-				{
-					FActorSpawnParameters ASP;
-					ASP.Name = FName(*ActorName);
-
-					GetWorld()->SpawnActor<AActor>(FoundClass, ASP);
-				}
-			}
-			else if (CreateFlag == CPPCLASS_CREATEFLAG)
+			// A reconnecting client is caught up with its own creations too, if their acknowledgement didn't reach it
+			if (FindActorByName(ActorName))
 			{
-				FString ClassName;
-				Ar << ClassName;
-
-				for (TObjectIterator<UClass> It; It; ++It)
-				{
-					if ((*It) && It->GetFName().ToString() == ClassName)
-					{
-						FActorSpawnParameters ASP;
-						ASP.Name = FName(*ActorName);
-
-						GetWorld()->SpawnActor<AActor>(*It, ASP);
-						break;
-					}
-				}
+				continue;
 			}
 
-			if (Ar.AtEnd())
+			AActor* SpawnedActor = SpawnSyncedActor(ActorName, CreateFlag, Path);
+			if (SpawnedActor)
 			{
-				return;
+				LastActorsNames.Add(SpawnedActor, SpawnedActor->GetFName());
 			}
+
 			continue;
 		}
 
@@ -835,66 +2259,38 @@ void FMapSyncEdMode::DeserializeAllActorsChange(FMemoryReader& Ar)
 		if (NextCmd == UPDATE_CMD)
 		{
 			bShouldContinue = true;
+			INC_DWORD_STAT(STAT_MapSyncUpdateCommands);
 
-			FString ActorName;
+			FName ActorName;
 			Ar << ActorName;
+			uint32 DataSize = 0;
+			Ar.SerializeIntPacked(DataSize);
+			const int64 DataEnd = Ar.Tell() + DataSize;
+			if (OutSummary) OutSummary->UpdatedActors.Add(ActorName);
 
-			for (TActorIterator<AActor> ActorIt(GetWorld()); ActorIt; ++ActorIt)
+			AActor* ActorToMod = FindActorByName(ActorName);
+			if (ActorToMod)
 			{
-				if (ActorIt->GetFName().ToString() == ActorName)
+				// If an actor to modify is selected, unselect it
+				for (FSelectionIterator SelectionIt = GEditor->GetSelectedActorIterator(); SelectionIt; ++SelectionIt)
 				{
-					AActor* ActorToMod = *ActorIt;
-
-					// If an actor to modify is selected, unselect it
-					for (FSelectionIterator SelectionIt = GEditor->GetSelectedActorIterator(); SelectionIt; ++SelectionIt)
-					{
-						if (ActorToMod == *SelectionIt)
-						{
-							GEditor->GetSelectedActors()->Deselect(ActorToMod);
-							break;
-						}
-					}
-
-					for (auto& Serializer : CustomSerializers)
+					if (ActorToMod == *SelectionIt)
 					{
-						if (ActorToMod->GetClass()->IsChildOf(Serializer->GetSupportedClass()) || ActorToMod->GetClass() == Serializer->GetSupportedClass())
-						{
-							Serializer->MapSyncSerialize(Ar, ActorToMod);
-						}
+						GEditor->GetSelectedActors()->Deselect(ActorToMod);
+						break;
 					}
-
-					break;
 				}
-			}
 
-			if (Ar.AtEnd())
-			{
-				break;
+				DeserializeActorDelta(ActorToMod, Ar);
 			}
+			// Skip the data of actors we don't have
+			Ar.Seek(DataEnd);
+
 			continue;
 		}
 	}
-}
-
-void FMapSyncEdMode::AppendArraysToNetData(TArray<uint8>& InputArray, TArray<uint8>& OutNetData)
-{
-	int32 BaseIdx = OutNetData.Num();
-	OutNetData.AddUninitialized(sizeof(int32));
-
-	*reinterpret_cast<int32*>(BaseIdx + OutNetData.GetData()) = InputArray.Num();
-	OutNetData.Append(InputArray);
-}
-
-void FMapSyncEdMode::NetDataToArrays(TArray<uint8>& NetData, TArray<TArray<uint8>>& OutArrays)
-{
-	OutArrays.Empty();
-	for (int32 CurrentIdx = 0; NetData.IsValidIndex(CurrentIdx + sizeof(int32)); )
-	{
-		int32 CurrentSize = *reinterpret_cast<int32*>(NetData.GetData() + CurrentIdx);
-		OutArrays.Add(TArray<uint8>(NetData.GetData() + CurrentIdx + sizeof(int32), CurrentSize));
 
-		CurrentIdx += CurrentSize + 4;
-	}
+	return true;
 }
 
 #undef LOCTEXT_NAMESPACE
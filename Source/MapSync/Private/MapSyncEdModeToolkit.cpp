@@ -4,6 +4,7 @@
 #include "MapSyncPrivatePCH.h"
 #include "MapSyncEdMode.h"
 #include "SMapSyncMenu.h"
+#include "SMapSyncDashboard.h"
 
 #define LOCTEXT_NAMESPACE "FMapSyncEdModeToolkit"
 
@@ -185,6 +186,17 @@ void FMapSyncEdModeToolkit::PrintServerUI()
 				return OwnerEdMode->bBound;
 			})
 		]
+		+ SVerticalBox::Slot()
+		.VAlign(VAlign_Top)
+		.AutoHeight()
+		.Padding(FMargin(0.f, 16.f, 0.f, 0.f))
+		[
+			SNew(SMapSyncDashboard)
+			.EdMode_Lambda([&]()
+			{
+				return OwnerEdMode;
+			})
+		]
 	];
 }
 
@@ -351,6 +363,17 @@ void FMapSyncEdModeToolkit::PrintClientUI()
 				return OwnerEdMode->bConnectedToServer;
 			})
 		]
+		+ SVerticalBox::Slot()
+		.VAlign(VAlign_Top)
+		.AutoHeight()
+		.Padding(FMargin(0.f, 16.f, 0.f, 0.f))
+		[
+			SNew(SMapSyncDashboard)
+			.EdMode_Lambda([&]()
+			{
+				return OwnerEdMode;
+			})
+		]
 	];
 }
 
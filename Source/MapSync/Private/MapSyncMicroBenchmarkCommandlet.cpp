@@ -0,0 +1,317 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncMicroBenchmarkCommandlet.h"
+#include "MapSyncPrivatePCH.h"
+#include "MapSyncEdMode.h"
+#include "MapSyncBenchmarkHelpers.h"
+#include "CustomSerialization.h"
+#include "Editor/UnrealEd/Public/EditorModeRegistry.h"
+#include "Editor/UnrealEd/Public/EditorModeManager.h"
+#include "Runtime/Engine/Classes/Engine/StaticMeshActor.h"
+#include "Runtime/Engine/Classes/Engine/PointLight.h"
+#include "Runtime/Engine/Classes/Engine/StaticMesh.h"
+#include "Runtime/Core/Public/Misc/FileHelper.h"
+
+#define MICROBENCHMARK_DEFAULT_ACTORS 10000 // Of each class
+#define MICROBENCHMARK_DEFAULT_PASSES 10
+#define MICROBENCHMARK_RECV_SIZE (64 * 1024) // Decoded streams are fed in chunks of this size, like the network worker does
+
+namespace
+{
+	// Runs Pass Passes times, returns the median time of a pass, in seconds
+	double TimePasses(int32 Passes, TFunctionRef<void()> Pass)
+	{
+		TArray<double> PassTimes;
+		for (int32 PassIdx = 0; PassIdx < Passes; PassIdx++)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			Pass();
+			PassTimes.Add(FPlatformTime::Seconds() - StartTime);
+		}
+		PassTimes.Sort();
+		return PassTimes[PassTimes.Num() / 2];
+	}
+
+	void AddMicroResult(FString& OutCsv, const FString& Benchmark, const FString& ActorClassName, int32 ActorCount, double PassTime, int64 PassBytes)
+	{
+		OutCsv += FString::Printf(TEXT("%s,%s,%d,%.1f,%.2f\n"), *Benchmark, *ActorClassName, ActorCount, PassTime * 1e9 / ActorCount, (double)PassBytes / ActorCount);
+	}
+}
+
+UMapSyncMicroBenchmarkCommandlet::UMapSyncMicroBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMapSyncMicroBenchmarkCommandlet::Main(const FString& Params)
+{
+	if (!GEditor)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("The MapSync micro benchmarks must run in the editor"));
+		return 1;
+	}
+
+	int32 ActorCount = MICROBENCHMARK_DEFAULT_ACTORS;
+	int32 Passes = MICROBENCHMARK_DEFAULT_PASSES;
+	FString BlueprintPath;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("MapSync") / TEXT("MicroBenchmark.csv");
+	FParse::Value(*Params, TEXT("Actors="), ActorCount);
+	FParse::Value(*Params, TEXT("Passes="), Passes);
+	FParse::Value(*Params, TEXT("Blueprint="), BlueprintPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	ActorCount = FMath::Max(ActorCount, 1);
+	Passes = FMath::Max(Passes, 1);
+
+	TArray<UClass*> ActorClasses = { AStaticMeshActor::StaticClass(), APointLight::StaticClass() };
+	if (!BlueprintPath.IsEmpty())
+	{
+		if (UClass* BlueprintClass = LoadObject<UClass>(nullptr, *BlueprintPath))
+		{
+			ActorClasses.Add(BlueprintClass);
+		}
+		else
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to load blueprint class %s, it won't be benchmarked"), *BlueprintPath);
+		}
+	}
+
+	UWorld* World = GEditor->NewMap();
+	TSharedPtr<FEdMode> EdMode = FEditorModeRegistry::Get().CreateMode(FMapSyncEdMode::EM_MapSyncEdModeId, GLevelEditorModeTools());
+	FMapSyncEdMode* Mode = static_cast<FMapSyncEdMode*>(EdMode.Get());
+	if (!World || !Mode)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("Unable to create the benchmark level, or the MapSync editor mode"));
+		return 1;
+	}
+
+	// Only what serializing needs, nothing is ever sent
+	Mode->StringTable.Reset(0);
+	Mode->BuildCustomSerializers();
+
+	UStaticMesh* Mesh = LoadObject<UStaticMesh>(nullptr, BENCHMARK_MESH_PATH);
+	FString Csv = TEXT("Benchmark,ActorClass,Actors,NsPerActor,BytesPerActor\n");
+	for (UClass* ActorClass : ActorClasses)
+	{
+		TArray<AActor*> Actors;
+		for (int32 ActorIdx = 0; ActorIdx < ActorCount; ActorIdx++)
+		{
+			if (AActor* Actor = FMapSyncBenchmarkUtils::SpawnBenchmarkActor(World, ActorClass, ActorIdx, Mesh))
+			{
+				Actors.Add(Actor);
+			}
+		}
+		if (Actors.Num() == 0)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Unable to spawn actors of class %s, it won't be benchmarked"), *ActorClass->GetName());
+			continue;
+		}
+
+		UE_LOG(LogMapSync, Display, TEXT("Benchmarking %d actors of class %s"), Actors.Num(), *ActorClass->GetName());
+		BenchmarkSerialization(*Mode, ActorClass->GetName(), Actors, Passes, Csv);
+		BenchmarkUnchangedCheck(*Mode, ActorClass->GetName(), Actors, Passes, Csv);
+		BenchmarkFraming(*Mode, ActorClass->GetName(), Actors, Passes, Csv);
+	}
+	EdMode.Reset();
+
+	if (!FFileHelper::SaveStringToFile(Csv, *OutputPath))
+	{
+		UE_LOG(LogMapSync, Error, TEXT("Unable to write the micro benchmark results to %s"), *OutputPath);
+		return 1;
+	}
+	UE_LOG(LogMapSync, Display, TEXT("MapSync micro benchmark results written to %s"), *OutputPath);
+	return 0;
+}
+
+void UMapSyncMicroBenchmarkCommandlet::BenchmarkSerialization(FMapSyncEdMode& Mode, const FString& ActorClassName, const TArray<AActor*>& Actors, int32 Passes, FString& OutCsv)
+{
+	// The whole chain, as sent when an actor is created
+	TArray<uint8> Bytes;
+	double PassTime = TimePasses(Passes, [&]()
+	{
+		Bytes.Reset();
+		FMapSyncWriter Ar(Bytes, Mode.StringTable);
+		for (AActor* Actor : Actors)
+		{
+			Mode.SerializeOneActorMod(Actor, Ar);
+		}
+	});
+	AddMicroResult(OutCsv, TEXT("SerializeOneActorMod"), ActorClassName, Actors.Num(), PassTime, Bytes.Num());
+
+	// Then every serializer of the class on its own. Deltas are against the state before a move, like a drag sends
+	const TArray<UCustomSerializer*>& Serializers = Mode.GetActorSerializers(Actors[0]);
+	TArray<TArray<TArray<uint8>>> Baselines; // By serializer, then by actor
+	Baselines.SetNum(Serializers.Num());
+	for (int32 SerializerIdx = 0; SerializerIdx < Serializers.Num(); SerializerIdx++)
+	{
+		Baselines[SerializerIdx].SetNum(Actors.Num());
+		for (int32 ActorIdx = 0; ActorIdx < Actors.Num(); ActorIdx++)
+		{
+			FMapSyncWriter BaselineAr(Baselines[SerializerIdx][ActorIdx], Mode.StringTable);
+			Serializers[SerializerIdx]->MapSyncSerialize(BaselineAr, Actors[ActorIdx]);
+		}
+	}
+	for (AActor* Actor : Actors)
+	{
+		Actor->SetActorLocation(Actor->GetActorLocation() + FVector(0.f, 0.f, 10.f));
+	}
+
+	for (int32 SerializerIdx = 0; SerializerIdx < Serializers.Num(); SerializerIdx++)
+	{
+		UCustomSerializer* Serializer = Serializers[SerializerIdx];
+		PassTime = TimePasses(Passes, [&]()
+		{
+			Bytes.Reset();
+			FMapSyncWriter Ar(Bytes, Mode.StringTable);
+			for (AActor* Actor : Actors)
+			{
+				Serializer->MapSyncSerialize(Ar, Actor);
+			}
+		});
+		AddMicroResult(OutCsv, TEXT("Serialize/") + Serializer->GetClass()->GetName(), ActorClassName, Actors.Num(), PassTime, Bytes.Num());
+
+		PassTime = TimePasses(Passes, [&]()
+		{
+			Bytes.Reset();
+			FMapSyncWriter Ar(Bytes, Mode.StringTable);
+			for (int32 ActorIdx = 0; ActorIdx < Actors.Num(); ActorIdx++)
+			{
+				FMapSyncReader BaselineAr(Baselines[SerializerIdx][ActorIdx], Mode.StringTable);
+				Serializer->MapSyncSerializeDelta(Ar, &BaselineAr, Actors[ActorIdx]);
+			}
+		});
+		AddMicroResult(OutCsv, TEXT("SerializeDelta/") + Serializer->GetClass()->GetName(), ActorClassName, Actors.Num(), PassTime, Bytes.Num());
+	}
+
+	for (AActor* Actor : Actors)
+	{
+		Actor->SetActorLocation(Actor->GetActorLocation() - FVector(0.f, 0.f, 10.f));
+	}
+}
+
+void UMapSyncMicroBenchmarkCommandlet::BenchmarkUnchangedCheck(FMapSyncEdMode& Mode, const FString& ActorClassName, const TArray<AActor*>& Actors, int32 Passes, FString& OutCsv)
+{
+	TArray<FMapSyncEdMode::FActorState> LastStates;
+	LastStates.SetNum(Actors.Num());
+	for (int32 ActorIdx = 0; ActorIdx < Actors.Num(); ActorIdx++)
+	{
+		Mode.CaptureActorState(Actors[ActorIdx], LastStates[ActorIdx]);
+	}
+
+	// What a dirty actor that didn't actually change costs: capturing its state, then comparing it with LastActorsData
+	int32 UnchangedCount = 0;
+	double PassTime = TimePasses(Passes, [&]()
+	{
+		UnchangedCount = 0;
+		FMapSyncEdMode::FActorState State;
+		for (int32 ActorIdx = 0; ActorIdx < Actors.Num(); ActorIdx++)
+		{
+			Mode.CaptureActorState(Actors[ActorIdx], State);
+			UnchangedCount += State == LastStates[ActorIdx] ? 1 : 0;
+		}
+	});
+	AddMicroResult(OutCsv, TEXT("CaptureAndCompare"), ActorClassName, Actors.Num(), PassTime, 0);
+	if (UnchangedCount != Actors.Num())
+	{
+		UE_LOG(LogMapSync, Warning, TEXT("%d %s actors didn't serialize the same twice in a row, they'll be sent on every change"), Actors.Num() - UnchangedCount, *ActorClassName);
+	}
+
+	// The comparison alone
+	TArray<FMapSyncEdMode::FActorState> States = LastStates;
+	PassTime = TimePasses(Passes, [&]()
+	{
+		UnchangedCount = 0;
+		for (int32 ActorIdx = 0; ActorIdx < Actors.Num(); ActorIdx++)
+		{
+			UnchangedCount += States[ActorIdx] == LastStates[ActorIdx] ? 1 : 0;
+		}
+	});
+	AddMicroResult(OutCsv, TEXT("Compare"), ActorClassName, Actors.Num(), PassTime, 0);
+}
+
+void UMapSyncMicroBenchmarkCommandlet::BenchmarkFraming(FMapSyncEdMode& Mode, const FString& ActorClassName, const TArray<AActor*>& Actors, int32 Passes, FString& OutCsv)
+{
+	// One frame per actor, the worst case for framing overhead
+	TArray<TArray<uint8>> Frames;
+	Frames.SetNum(Actors.Num());
+	for (int32 ActorIdx = 0; ActorIdx < Actors.Num(); ActorIdx++)
+	{
+		FMapSyncWriter Ar(Frames[ActorIdx], Mode.StringTable);
+		Mode.SerializeOneActorMod(Actors[ActorIdx], Ar);
+	}
+
+	TArray<uint8> NetData;
+	double PassTime = TimePasses(Passes, [&]()
+	{
+		NetData.Reset();
+		for (const TArray<uint8>& Frame : Frames)
+		{
+			FMapSyncNetworkWorker::AppendArraysToNetData(Frame, NetData);
+		}
+	});
+	AddMicroResult(OutCsv, TEXT("AppendArraysToNetData"), ActorClassName, Actors.Num(), PassTime, NetData.Num());
+
+	// Decoded back from the stream, as received
+	int32 DecodedCount = 0;
+	PassTime = TimePasses(Passes, [&]()
+	{
+		FMapSyncFrameDecoder Decoder;
+		DecodedCount = 0;
+		for (int32 Offset = 0; Offset < NetData.Num(); Offset += MICROBENCHMARK_RECV_SIZE)
+		{
+			const int32 Size = FMath::Min(MICROBENCHMARK_RECV_SIZE, NetData.Num() - Offset);
+			FMemory::Memcpy(Decoder.GetWriteBuffer(Size), NetData.GetData() + Offset, Size);
+			Decoder.CommitWrite(Size);
+
+			TArrayView<const uint8> Frame;
+			bool bCompressed = false;
+			bool bCorrupted = false;
+			while (Decoder.NextFrame(Frame, bCompressed, bCorrupted))
+			{
+				DecodedCount++;
+			}
+		}
+	});
+	AddMicroResult(OutCsv, TEXT("FrameDecoder"), ActorClassName, Actors.Num(), PassTime, NetData.Num());
+	if (DecodedCount != Frames.Num())
+	{
+		UE_LOG(LogMapSync, Warning, TEXT("Only %d frames out of %d were decoded"), DecodedCount, Frames.Num());
+	}
+
+	// Every actor in a single frame, compressed, the way big updates go out
+	FMapSyncCompressionSettings Compression;
+	Compression.Format = COMPRESSION_DEFAULT_FORMAT;
+	if (!FMapSyncNetworkWorker::IsCompressionFormatSupported(Compression.Format))
+	{
+		return;
+	}
+
+	TArray<uint8> Update;
+	for (const TArray<uint8>& Frame : Frames)
+	{
+		Update.Append(Frame);
+	}
+	bool bCompressed = false;
+	PassTime = TimePasses(Passes, [&]()
+	{
+		NetData.Reset();
+		bCompressed = FMapSyncNetworkWorker::AppendCompressedArraysToNetData(Update, Compression, NetData);
+	});
+	if (!bCompressed)
+	{
+		return;
+	}
+	AddMicroResult(OutCsv, TEXT("AppendCompressedArraysToNetData"), ActorClassName, Actors.Num(), PassTime, NetData.Num());
+
+	// Without its size prefix, as the decoder hands it out
+	TArrayView<const uint8> CompressedFrame(NetData.GetData() + sizeof(int32), NetData.Num() - sizeof(int32));
+	TArray<uint8> Payload;
+	PassTime = TimePasses(Passes, [&]()
+	{
+		Payload.Reset();
+		FMapSyncNetworkWorker::DecompressFrame(CompressedFrame, Payload);
+	});
+	AddMicroResult(OutCsv, TEXT("DecompressFrame"), ActorClassName, Actors.Num(), PassTime, Payload.Num());
+}
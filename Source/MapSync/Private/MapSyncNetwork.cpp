@@ -0,0 +1,734 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncNetwork.h"
+#include "MapSyncPrivatePCH.h"
+#include "MapSyncRecording.h"
+
+// How long the worker sleeps when there's nothing to do, in milliseconds
+#define NETWORK_IDLE_WAIT_MS 1
+// How long the worker keeps trying to send what's left when shutting down, in seconds
+#define NETWORK_SHUTDOWN_FLUSH_TIME 1.0
+// Size of a single socket read, in bytes
+#define NETWORK_RECV_SIZE 65536
+
+// Formats a compressed frame may use, a frame stores the index of its format in this array
+static const TCHAR* const NetworkCompressionFormats[] = { TEXT("Zlib"), TEXT("Gzip"), TEXT("LZ4") };
+
+TUniquePtr<FMapSyncNetworkWorker> FMapSyncNetworkWorker::Listen(int32 Port)
+{
+	FIPv4Address Adress;
+	FIPv4Address::Parse(TEXT("0.0.0.0"), Adress);
+	FIPv4Endpoint Endpoint(Adress, Port);
+	FSocket* ListenSocket = FTcpSocketBuilder(TEXT("Server"))
+		.AsReusable()
+		.AsNonBlocking()
+		.BoundToEndpoint(Endpoint)
+		.Listening(16);
+
+	if (!ListenSocket)
+	{
+		return nullptr;
+	}
+
+	TUniquePtr<FMapSyncNetworkWorker> Worker(new FMapSyncNetworkWorker(ListenSocket, nullptr));
+	Worker->StartThread();
+	return Worker;
+}
+
+TUniquePtr<FMapSyncNetworkWorker> FMapSyncNetworkWorker::Connect(const FIPv4Endpoint& ServerEndpoint)
+{
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	FSocket* ServerSocket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("default"), false);
+	if (!ServerSocket)
+	{
+		return nullptr;
+	}
+
+	// The connection itself is blocking, so that the caller knows right away whether it worked
+	if (!ServerSocket->Connect(*ServerEndpoint.ToInternetAddr()))
+	{
+		SocketSubsystem->DestroySocket(ServerSocket);
+		return nullptr;
+	}
+	ServerSocket->SetNonBlocking(true);
+
+	TUniquePtr<FMapSyncNetworkWorker> Worker(new FMapSyncNetworkWorker(nullptr, ServerSocket));
+	Worker->StartThread();
+	return Worker;
+}
+
+FMapSyncNetworkWorker::FMapSyncNetworkWorker(FSocket* InListenSocket, FSocket* InServerSocket)
+	: ListenSocket(InListenSocket), NextPeerId(0), Thread(nullptr), Recorder(nullptr)
+{
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	if (InServerSocket)
+	{
+		int32 PeerId = AddPeer(InServerSocket, true);
+		PushInbound(EMapSyncNetEvent::Connected, PeerId);
+	}
+}
+
+FMapSyncNetworkWorker::~FMapSyncNetworkWorker()
+{
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	WorkEvent = nullptr;
+}
+
+void FMapSyncNetworkWorker::StartThread()
+{
+	Thread = FRunnableThread::Create(this, TEXT("MapSyncNetwork"), 0, TPri_AboveNormal);
+}
+
+void FMapSyncNetworkWorker::Send(int32 PeerId, TArray<uint8>&& Payload, int32 ExceptPeerId, bool bDroppable)
+{
+	FMapSyncNetOutbound Outbound;
+	Outbound.PeerId = PeerId;
+	Outbound.ExceptPeerId = ExceptPeerId;
+	Outbound.Payload = MoveTemp(Payload);
+	Outbound.bDroppable = bDroppable;
+	Enqueue(MoveTemp(Outbound));
+}
+
+void FMapSyncNetworkWorker::Multicast(const TArray<int32>& PeerIds, TArray<uint8>&& Payload, bool bDroppable)
+{
+	if (PeerIds.Num() == 0)
+	{
+		return;
+	}
+
+	FMapSyncNetOutbound Outbound;
+	Outbound.PeerId = INDEX_NONE;
+	Outbound.ExceptPeerId = INDEX_NONE;
+	Outbound.PeerIds = PeerIds;
+	Outbound.Payload = MoveTemp(Payload);
+	Outbound.bDroppable = bDroppable;
+	Enqueue(MoveTemp(Outbound));
+}
+
+void FMapSyncNetworkWorker::Close(int32 PeerId)
+{
+	FMapSyncNetOutbound Outbound;
+	Outbound.PeerId = PeerId;
+	Outbound.ExceptPeerId = INDEX_NONE;
+	Outbound.bClose = true;
+	Enqueue(MoveTemp(Outbound));
+}
+
+void FMapSyncNetworkWorker::DropQueued(int32 PeerId)
+{
+	FMapSyncNetOutbound Outbound;
+	Outbound.PeerId = PeerId;
+	Outbound.ExceptPeerId = INDEX_NONE;
+	Outbound.bDropQueued = true;
+	Enqueue(MoveTemp(Outbound));
+}
+
+void FMapSyncNetworkWorker::SetCompression(int32 PeerId, const FMapSyncCompressionSettings& Compression)
+{
+	// Goes through the outbound queue, so that it's ordered with the frames sent
+	FMapSyncNetOutbound Outbound;
+	Outbound.PeerId = PeerId;
+	Outbound.ExceptPeerId = INDEX_NONE;
+	Outbound.bSetCompression = true;
+	Outbound.Compression = Compression;
+	Enqueue(MoveTemp(Outbound));
+}
+
+void FMapSyncNetworkWorker::Enqueue(FMapSyncNetOutbound&& Outbound)
+{
+	if (Recorder)
+	{
+		Recorder->RecordOutbound(Outbound);
+	}
+
+	if (Outbound.Payload.Num() > 0)
+	{
+		FScopeLock Lock(&PeersStatsLock);
+		for (auto& PeerStats : PeersStats)
+		{
+			if (IsTarget(Outbound, PeerStats.Key))
+			{
+				PeerStats.Value->QueuedBytes.Add(Outbound.Payload.Num() + sizeof(int32));
+				Outbound.CountedPeerIds.Add(PeerStats.Key);
+			}
+		}
+	}
+
+	OutboundQueue.Enqueue(MoveTemp(Outbound));
+	WorkEvent->Trigger();
+}
+
+bool FMapSyncNetworkWorker::IsTarget(const FMapSyncNetOutbound& Outbound, int32 PeerId)
+{
+	if (Outbound.PeerIds.Num() > 0)
+	{
+		return Outbound.PeerIds.Contains(PeerId);
+	}
+	if (Outbound.PeerId == MAPSYNC_ALL_PEERS)
+	{
+		return Outbound.ExceptPeerId != PeerId;
+	}
+	return Outbound.PeerId == PeerId;
+}
+
+bool FMapSyncNetworkWorker::Dequeue(FMapSyncNetInbound& OutInbound)
+{
+	if (!InboundQueue.Dequeue(OutInbound))
+	{
+		return false;
+	}
+	if (Recorder)
+	{
+		Recorder->RecordInbound(OutInbound);
+	}
+	return true;
+}
+
+bool FMapSyncNetworkWorker::HasInbound() const
+{
+	return !InboundQueue.IsEmpty();
+}
+
+int64 FMapSyncNetworkWorker::GetQueuedBytes(int32 PeerId)
+{
+	FScopeLock Lock(&PeersStatsLock);
+	FMapSyncPeerStatsPtr* PeerStats = PeersStats.Find(PeerId);
+	return PeerStats ? (*PeerStats)->QueuedBytes.GetValue() : 0;
+}
+
+uint32 FMapSyncNetworkWorker::Run()
+{
+	while (!bStopping)
+	{
+		bool bDidWork = false;
+
+		// Take what the game thread wants to send
+		FMapSyncNetOutbound Outbound;
+		while (OutboundQueue.Dequeue(Outbound))
+		{
+			ProcessOutbound(Outbound);
+			bDidWork = true;
+		}
+
+		// If has a pending client wanting to connect, accept it
+		bool bHasPendingConnection = false;
+		while (ListenSocket && ListenSocket->HasPendingConnection(bHasPendingConnection) && bHasPendingConnection)
+		{
+			FSocket* ClientSocket = ListenSocket->Accept(TEXT("client") + FString::FromInt(FMath::RandHelper(1000000)));
+			if (!ClientSocket)
+			{
+				break;
+			}
+			ClientSocket->SetNonBlocking(true);
+
+			int32 PeerId = AddPeer(ClientSocket, false);
+			PushInbound(EMapSyncNetEvent::Connected, PeerId);
+			bDidWork = true;
+		}
+
+		// Send and receive
+		for (FPeer& Peer : Peers)
+		{
+			bDidWork |= FlushPeer(Peer);
+			bDidWork |= ReceiveFromPeer(Peer);
+		}
+
+		// Forget about peers that disconnected
+		for (int32 PeerIdx = Peers.Num() - 1; PeerIdx >= 0; PeerIdx--)
+		{
+			if (Peers[PeerIdx].bClosed)
+			{
+				PushInbound(EMapSyncNetEvent::Disconnected, Peers[PeerIdx].Id);
+				Peers.RemoveAtSwap(PeerIdx);
+			}
+		}
+
+		if (!bDidWork)
+		{
+			WorkEvent->Wait(NETWORK_IDLE_WAIT_MS);
+		}
+	}
+
+	// Give what was enqueued before stopping (typically an exit message) a chance to go out
+	FMapSyncNetOutbound Outbound;
+	while (OutboundQueue.Dequeue(Outbound))
+	{
+		ProcessOutbound(Outbound);
+	}
+	const double FlushEndTime = FPlatformTime::Seconds() + NETWORK_SHUTDOWN_FLUSH_TIME;
+	bool bHasDataToSend = true;
+	while (bHasDataToSend && FPlatformTime::Seconds() < FlushEndTime)
+	{
+		bHasDataToSend = false;
+		for (FPeer& Peer : Peers)
+		{
+			FlushPeer(Peer);
+			bHasDataToSend |= !Peer.bClosed && Peer.SendQueueHead < Peer.SendQueue.Num();
+		}
+		if (bHasDataToSend)
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+
+	for (FPeer& Peer : Peers)
+	{
+		ClosePeer(Peer);
+	}
+	Peers.Empty();
+
+	if (ListenSocket)
+	{
+		ListenSocket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+	}
+
+	return 0;
+}
+
+void FMapSyncNetworkWorker::Stop()
+{
+	bStopping = true;
+	WorkEvent->Trigger();
+}
+
+int32 FMapSyncNetworkWorker::AddPeer(FSocket* Socket, bool bJoinBroadcasts)
+{
+	FPeer Peer;
+	Peer.Id = NextPeerId++;
+	Peer.Socket = Socket;
+	Peer.SendQueueHead = 0;
+	Peer.SendOffset = 0;
+	Peer.bCloseWhenSent = false;
+	Peer.bClosed = false;
+	Peer.bJoinedBroadcasts = bJoinBroadcasts;
+	Peer.Stats = MakeShared<FMapSyncPeerStats, ESPMode::ThreadSafe>();
+	{
+		FScopeLock Lock(&PeersStatsLock);
+		PeersStats.Add(Peer.Id, Peer.Stats);
+	}
+	Peers.Add(MoveTemp(Peer));
+	return Peers.Last().Id;
+}
+
+void FMapSyncNetworkWorker::ProcessOutbound(FMapSyncNetOutbound& Outbound)
+{
+	// The frame is built once, on first use, and shared by every peer it goes to. Same for its compressed version, for peers with the same settings
+	FMapSyncFramePtr RawFrame;
+	FMapSyncFramePtr CompressedFrame;
+	FMapSyncCompressionSettings CompressedWith;
+	bool bHasCompressed = false;
+
+	for (FPeer& Peer : Peers)
+	{
+		if (Peer.bClosed || Peer.bCloseWhenSent || !IsTarget(Outbound, Peer.Id))
+		{
+			continue;
+		}
+		// Peers accepted after the frame was enqueued weren't counted
+		const bool bCounted = Outbound.CountedPeerIds.Contains(Peer.Id);
+		if (Outbound.PeerId == MAPSYNC_ALL_PEERS && Outbound.PeerIds.Num() == 0 && !Peer.bJoinedBroadcasts)
+		{
+			if (bCounted)
+			{
+				Peer.Stats->QueuedBytes.Subtract(Outbound.Payload.Num() + sizeof(int32));
+			}
+			continue;
+		}
+		Peer.bJoinedBroadcasts = true;
+
+		if (Outbound.bSetCompression)
+		{
+			Peer.Compression = Outbound.Compression;
+		}
+		if (Outbound.bDropQueued)
+		{
+			DropQueuedFrames(Peer);
+		}
+
+		if (Outbound.Payload.Num() > 0)
+		{
+			// Counted now, as it's subtracted once sent
+			if (!bCounted)
+			{
+				Peer.Stats->QueuedBytes.Add(Outbound.Payload.Num() + sizeof(int32));
+			}
+
+			const FMapSyncCompressionSettings& Compression = Peer.Compression;
+			if (Compression.Format != NAME_None && Outbound.Payload.Num() >= Compression.Threshold)
+			{
+				if (!bHasCompressed || CompressedWith.Format != Compression.Format || CompressedWith.Flags != Compression.Flags)
+				{
+					TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> NewFrame = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+					CompressedFrame.Reset();
+					if (AppendCompressedArraysToNetData(Outbound.Payload, Compression, *NewFrame))
+					{
+						CompressedFrame = NewFrame;
+					}
+					CompressedWith = Compression;
+					bHasCompressed = true;
+				}
+				if (CompressedFrame.IsValid())
+				{
+					Peer.SendQueue.Add({ CompressedFrame, Outbound.bDroppable });
+					// The uncompressed size was counted when enqueued
+					Peer.Stats->QueuedBytes.Subtract(Outbound.Payload.Num() + sizeof(int32) - CompressedFrame->Num());
+					Peer.bCloseWhenSent |= Outbound.bClose;
+					continue;
+				}
+			}
+
+			if (!RawFrame.IsValid())
+			{
+				TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> NewFrame = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+				AppendArraysToNetData(Outbound.Payload, *NewFrame);
+				RawFrame = NewFrame;
+			}
+			Peer.SendQueue.Add({ RawFrame, Outbound.bDroppable });
+		}
+		Peer.bCloseWhenSent |= Outbound.bClose;
+	}
+}
+
+void FMapSyncNetworkWorker::DropQueuedFrames(FPeer& Peer)
+{
+	// A frame partially sent must be finished, or the stream would be corrupted
+	const int32 FirstDroppableIdx = Peer.SendOffset > 0 ? Peer.SendQueueHead + 1 : Peer.SendQueueHead;
+	int64 DroppedBytes = 0;
+	for (int32 FrameIdx = Peer.SendQueue.Num() - 1; FrameIdx >= FirstDroppableIdx; FrameIdx--)
+	{
+		if (Peer.SendQueue[FrameIdx].bDroppable)
+		{
+			DroppedBytes += Peer.SendQueue[FrameIdx].Frame->Num();
+			Peer.SendQueue.RemoveAt(FrameIdx, 1, false);
+		}
+	}
+	Peer.Stats->QueuedBytes.Subtract(DroppedBytes);
+
+	if (DroppedBytes > 0)
+	{
+		UE_LOG(LogMapSync, Log, TEXT("Dropped %lld queued bytes for %s"), DroppedBytes, *Peer.Socket->GetDescription());
+	}
+}
+
+bool FMapSyncNetworkWorker::FlushPeer(FPeer& Peer)
+{
+	if (Peer.bClosed)
+	{
+		return false;
+	}
+
+	// FSocket has no vectored send, so each queued frame is sent straight from its shared buffer
+	bool bSentSomething = false;
+	while (Peer.SendQueueHead < Peer.SendQueue.Num())
+	{
+		const TArray<uint8>& Frame = *Peer.SendQueue[Peer.SendQueueHead].Frame;
+		int32 Sent = 0;
+		if (!Peer.Socket->Send(Frame.GetData() + Peer.SendOffset, Frame.Num() - Peer.SendOffset, Sent))
+		{
+			// The socket's buffer is full, we'll continue where we stopped next time
+			if (ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode() == SE_EWOULDBLOCK)
+			{
+				break;
+			}
+
+			UE_LOG(LogMapSync, Warning, TEXT("Failed to send data to %s, closing the connection"), *Peer.Socket->GetDescription());
+			ClosePeer(Peer);
+			return bSentSomething;
+		}
+		if (Sent <= 0)
+		{
+			break;
+		}
+
+		Peer.SendOffset += Sent;
+		Peer.Stats->QueuedBytes.Subtract(Sent);
+		Peer.Stats->BytesSent.Add(Sent);
+		INC_DWORD_STAT_BY(STAT_MapSyncBytesOut, Sent);
+		bSentSomething = true;
+
+		// Done with this frame, release our reference to it
+		if (Peer.SendOffset >= Frame.Num())
+		{
+			INC_DWORD_STAT(STAT_MapSyncFramesOut);
+			Peer.SendQueue[Peer.SendQueueHead].Frame.Reset();
+			Peer.SendQueueHead++;
+			Peer.SendOffset = 0;
+		}
+	}
+
+	// Everything was sent, reuse the queue
+	if (Peer.SendQueueHead >= Peer.SendQueue.Num())
+	{
+		Peer.SendQueue.Reset();
+		Peer.SendQueueHead = 0;
+
+		if (Peer.bCloseWhenSent)
+		{
+			ClosePeer(Peer);
+		}
+	}
+	// Or at least don't let the sent part grow forever when the peer never catches up
+	else if (Peer.SendQueueHead > Peer.SendQueue.Num() / 2)
+	{
+		Peer.SendQueue.RemoveAt(0, Peer.SendQueueHead, false);
+		Peer.SendQueueHead = 0;
+	}
+
+	return bSentSomething;
+}
+
+bool FMapSyncNetworkWorker::ReceiveFromPeer(FPeer& Peer)
+{
+	if (Peer.bClosed)
+	{
+		return false;
+	}
+
+	bool bReceivedSomething = false;
+	for (;;)
+	{
+		// Receive raw data, straight into the decoder's buffer. On a non blocking socket, Recv succeeds with nothing read when there's no data,
+		// and fails when the other side closed the connection
+		int32 DataRead = 0;
+		if (!Peer.Socket->Recv(Peer.Decoder.GetWriteBuffer(NETWORK_RECV_SIZE), NETWORK_RECV_SIZE, DataRead, ESocketReceiveFlags::None))
+		{
+			ClosePeer(Peer);
+			break;
+		}
+		if (DataRead <= 0)
+		{
+			break;
+		}
+		Peer.Decoder.CommitWrite(DataRead);
+		Peer.Stats->BytesReceived.Add(DataRead);
+		INC_DWORD_STAT_BY(STAT_MapSyncBytesIn, DataRead);
+		bReceivedSomething = true;
+
+		// Hand every complete frame to the game thread, what's left stays in the decoder until the next read
+		TArrayView<const uint8> Frame;
+		bool bCompressed = false;
+		bool bCorrupted = false;
+		while (Peer.Decoder.NextFrame(Frame, bCompressed, bCorrupted))
+		{
+			INC_DWORD_STAT(STAT_MapSyncFramesIn);
+			if (!bCompressed)
+			{
+				PushInbound(EMapSyncNetEvent::Frame, Peer.Id, TArray<uint8>(Frame.GetData(), Frame.Num()));
+				continue;
+			}
+
+			TArray<uint8> Payload;
+			if (!DecompressFrame(Frame, Payload))
+			{
+				bCorrupted = true;
+				break;
+			}
+			PushInbound(EMapSyncNetEvent::Frame, Peer.Id, MoveTemp(Payload));
+		}
+		if (bCorrupted)
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Received corrupted data from %s, closing the connection"), *Peer.Socket->GetDescription());
+			ClosePeer(Peer);
+			break;
+		}
+	}
+
+	return bReceivedSomething;
+}
+
+void FMapSyncNetworkWorker::ClosePeer(FPeer& Peer)
+{
+	if (Peer.bClosed)
+	{
+		return;
+	}
+
+	Peer.bClosed = true;
+	Peer.Socket->Close();
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Peer.Socket);
+	Peer.Socket = nullptr;
+	Peer.SendQueue.Empty();
+	Peer.SendQueueHead = 0;
+	Peer.SendOffset = 0;
+	Peer.Stats->QueuedBytes.Reset();
+
+	FScopeLock Lock(&PeersStatsLock);
+	PeersStats.Remove(Peer.Id);
+}
+
+void FMapSyncNetworkWorker::PushInbound(EMapSyncNetEvent Event, int32 PeerId, TArray<uint8>&& Payload)
+{
+	FMapSyncNetInbound Inbound;
+	Inbound.Event = Event;
+	Inbound.PeerId = PeerId;
+	Inbound.Payload = MoveTemp(Payload);
+	if (Event == EMapSyncNetEvent::Connected)
+	{
+		FScopeLock Lock(&PeersStatsLock);
+		Inbound.Stats = PeersStats.FindRef(PeerId);
+	}
+	InboundQueue.Enqueue(MoveTemp(Inbound));
+}
+
+void FMapSyncNetworkWorker::AppendArraysToNetData(const TArray<uint8>& InputArray, TArray<uint8>& OutNetData)
+{
+	int32 BaseIdx = OutNetData.Num();
+	OutNetData.AddUninitialized(sizeof(int32));
+
+	*reinterpret_cast<int32*>(BaseIdx + OutNetData.GetData()) = InputArray.Num();
+	OutNetData.Append(InputArray);
+}
+
+bool FMapSyncNetworkWorker::AppendCompressedArraysToNetData(const TArray<uint8>& InputArray, const FMapSyncCompressionSettings& Compression, TArray<uint8>& OutNetData)
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Compress);
+
+	int32 FormatIdx = INDEX_NONE;
+	for (int32 i = 0; i < ARRAY_COUNT(NetworkCompressionFormats); i++)
+	{
+		if (Compression.Format == NetworkCompressionFormats[i])
+		{
+			FormatIdx = i;
+			break;
+		}
+	}
+	if (FormatIdx == INDEX_NONE)
+	{
+		return false;
+	}
+
+	// [int32 size | flag][uint8 format][int32 uncompressed size][compressed payload]
+	const int32 HeaderSize = sizeof(int32) + sizeof(uint8) + sizeof(int32);
+	int32 CompressedSize = FCompression::CompressMemoryBound(Compression.Format, InputArray.Num(), Compression.Flags);
+	const int32 BaseIdx = OutNetData.Num();
+	OutNetData.AddUninitialized(HeaderSize + CompressedSize);
+
+	if (!FCompression::CompressMemory(Compression.Format, OutNetData.GetData() + BaseIdx + HeaderSize, CompressedSize, InputArray.GetData(), InputArray.Num(), Compression.Flags)
+		|| CompressedSize + sizeof(uint8) + sizeof(int32) >= (uint32)InputArray.Num())
+	{
+		OutNetData.SetNum(BaseIdx, false);
+		return false;
+	}
+	OutNetData.SetNum(BaseIdx + HeaderSize + CompressedSize, false);
+
+	uint8* Header = OutNetData.GetData() + BaseIdx;
+	const int32 FrameSize = (sizeof(uint8) + sizeof(int32) + CompressedSize) | MAPSYNC_COMPRESSED_FRAME_FLAG;
+	const int32 UncompressedSize = InputArray.Num();
+	FMemory::Memcpy(Header, &FrameSize, sizeof(int32));
+	Header[sizeof(int32)] = (uint8)FormatIdx;
+	FMemory::Memcpy(Header + sizeof(int32) + sizeof(uint8), &UncompressedSize, sizeof(int32));
+	return true;
+}
+
+bool FMapSyncNetworkWorker::DecompressFrame(const TArrayView<const uint8>& Frame, TArray<uint8>& OutPayload)
+{
+	MAPSYNC_SCOPE_CYCLE_COUNTER(Decompress);
+
+	const int32 HeaderSize = sizeof(uint8) + sizeof(int32);
+	if (Frame.Num() < HeaderSize)
+	{
+		return false;
+	}
+
+	const uint8 FormatIdx = Frame[0];
+	int32 UncompressedSize = 0;
+	FMemory::Memcpy(&UncompressedSize, Frame.GetData() + sizeof(uint8), sizeof(int32));
+	if (FormatIdx >= ARRAY_COUNT(NetworkCompressionFormats) || UncompressedSize <= 0 || UncompressedSize > MAPSYNC_MAX_FRAME_SIZE)
+	{
+		return false;
+	}
+
+	OutPayload.SetNumUninitialized(UncompressedSize);
+	return FCompression::UncompressMemory(NetworkCompressionFormats[FormatIdx], OutPayload.GetData(), UncompressedSize, Frame.GetData() + HeaderSize, Frame.Num() - HeaderSize);
+}
+
+bool FMapSyncNetworkWorker::IsCompressionFormatSupported(FName Format)
+{
+	for (const TCHAR* SupportedFormat : NetworkCompressionFormats)
+	{
+		if (Format == SupportedFormat)
+		{
+			return FCompression::IsFormatValid(Format);
+		}
+	}
+	return false;
+}
+
+FMapSyncFrameDecoder::FMapSyncFrameDecoder()
+	: ReadIdx(0), WriteIdx(0)
+{
+}
+
+uint8* FMapSyncFrameDecoder::GetWriteBuffer(int32 MinSize)
+{
+	// Everything was decoded, wrap back to the start
+	if (ReadIdx == WriteIdx)
+	{
+		ReadIdx = 0;
+		WriteIdx = 0;
+	}
+
+	if (Buffer.Num() - WriteIdx < MinSize)
+	{
+		// Move the beginning of the incomplete frame to the front, then grow if that's still not enough
+		if (ReadIdx > 0)
+		{
+			FMemory::Memmove(Buffer.GetData(), Buffer.GetData() + ReadIdx, WriteIdx - ReadIdx);
+			WriteIdx -= ReadIdx;
+			ReadIdx = 0;
+		}
+		if (Buffer.Num() - WriteIdx < MinSize)
+		{
+			Buffer.SetNumUninitialized(WriteIdx + MinSize);
+		}
+	}
+
+	return Buffer.GetData() + WriteIdx;
+}
+
+void FMapSyncFrameDecoder::CommitWrite(int32 Size)
+{
+	check(WriteIdx + Size <= Buffer.Num());
+	WriteIdx += Size;
+}
+
+bool FMapSyncFrameDecoder::NextFrame(TArrayView<const uint8>& OutFrame, bool& bOutCompressed, bool& bOutCorrupted)
+{
+	bOutCorrupted = false;
+
+	// Wait for the size to be fully received
+	if (WriteIdx - ReadIdx < (int32)sizeof(int32))
+	{
+		return false;
+	}
+
+	int32 FrameSize = 0;
+	FMemory::Memcpy(&FrameSize, Buffer.GetData() + ReadIdx, sizeof(int32));
+	bOutCompressed = (FrameSize & MAPSYNC_COMPRESSED_FRAME_FLAG) != 0;
+	FrameSize &= ~MAPSYNC_COMPRESSED_FRAME_FLAG;
+	// Every frame starts with its header, an empty one can't come from a peer
+	if (FrameSize <= 0 || FrameSize > MAPSYNC_MAX_FRAME_SIZE)
+	{
+		bOutCorrupted = true;
+		return false;
+	}
+
+	// Wait for the payload to be fully received
+	if (WriteIdx - ReadIdx - (int32)sizeof(int32) < FrameSize)
+	{
+		return false;
+	}
+
+	OutFrame = TArrayView<const uint8>(Buffer.GetData() + ReadIdx + sizeof(int32), FrameSize);
+	ReadIdx += sizeof(int32) + FrameSize;
+	return true;
+}
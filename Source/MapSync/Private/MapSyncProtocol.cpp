@@ -0,0 +1,172 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncProtocol.h"
+#include "MapSyncPrivatePCH.h"
+
+FMapSyncStringTable::FMapSyncStringTable()
+	: LocalSenderId(0), NextIndex(0)
+{
+}
+
+void FMapSyncStringTable::Reset(uint32 InLocalSenderId)
+{
+	FWriteScopeLock WriteLock(Lock);
+	Ids.Empty();
+	Names.Empty();
+	PendingIds.Empty();
+	LocalSenderId = InLocalSenderId;
+	NextIndex = 0;
+}
+
+uint64 FMapSyncStringTable::Intern(const FName& Name)
+{
+	// Reuse the id whoever allocated it. Most strings are already known, so only lock for writing to allocate
+	{
+		FReadScopeLock ReadLock(Lock);
+		if (const uint64* FoundId = Ids.Find(Name))
+		{
+			return *FoundId;
+		}
+	}
+
+	FWriteScopeLock WriteLock(Lock);
+	if (const uint64* FoundId = Ids.Find(Name))
+	{
+		return *FoundId;
+	}
+
+	const uint64 Id = (static_cast<uint64>(LocalSenderId) << 32) | NextIndex++;
+	Ids.Add(Name, Id);
+	Names.Add(Id, Name);
+	PendingIds.Add(Id);
+	return Id;
+}
+
+void FMapSyncStringTable::Define(uint64 Id, const FName& Name)
+{
+	FWriteScopeLock WriteLock(Lock);
+	Names.Add(Id, Name);
+	if (!Ids.Contains(Name))
+	{
+		Ids.Add(Name, Id);
+	}
+}
+
+FName FMapSyncStringTable::Resolve(uint64 Id) const
+{
+	FReadScopeLock ReadLock(Lock);
+	const FName* FoundName = Names.Find(Id);
+	if (!FoundName)
+	{
+		UE_LOG(LogMapSync, Warning, TEXT("Unknown string id %u:%u"), static_cast<uint32>(Id >> 32), static_cast<uint32>(Id));
+		return NAME_None;
+	}
+	return *FoundName;
+}
+
+void FMapSyncStringTable::SerializeStrings(FArchive& Ar, const TArray<uint64>& InIds)
+{
+	uint32 Count = InIds.Num();
+	Ar.SerializeIntPacked(Count);
+	for (uint64 Id : InIds)
+	{
+		SerializeId(Ar, Id);
+		FString String;
+		{
+			FReadScopeLock ReadLock(Lock);
+			String = Names.FindRef(Id).ToString();
+		}
+		Ar << String;
+	}
+}
+
+void FMapSyncStringTable::DeserializeStrings(FArchive& Ar)
+{
+	uint32 Count = 0;
+	Ar.SerializeIntPacked(Count);
+	for (uint32 i = 0; i < Count && !Ar.IsError(); i++)
+	{
+		uint64 Id = 0;
+		SerializeId(Ar, Id);
+		FString String;
+		Ar << String;
+		Define(Id, FName(*String));
+	}
+}
+
+bool FMapSyncStringTable::HasPendingStrings() const
+{
+	FReadScopeLock ReadLock(Lock);
+	return PendingIds.Num() > 0;
+}
+
+void FMapSyncStringTable::TakePendingStrings(TArray<uint64>& OutIds)
+{
+	FWriteScopeLock WriteLock(Lock);
+	OutIds = MoveTemp(PendingIds);
+	PendingIds.Reset();
+}
+
+void FMapSyncStringTable::GetAllStrings(TArray<uint64>& OutIds) const
+{
+	FReadScopeLock ReadLock(Lock);
+	Names.GenerateKeyArray(OutIds);
+}
+
+void FMapSyncStringTable::SerializeId(FArchive& Ar, uint64& Id)
+{
+	uint32 SenderId = static_cast<uint32>(Id >> 32);
+	uint32 Index = static_cast<uint32>(Id);
+	Ar.SerializeIntPacked(SenderId);
+	Ar.SerializeIntPacked(Index);
+	Id = (static_cast<uint64>(SenderId) << 32) | Index;
+}
+
+FMapSyncWriter::FMapSyncWriter(TArray<uint8>& InBytes, FMapSyncStringTable& InStringTable)
+	: FMemoryWriter(InBytes, true), StringTable(InStringTable)
+{
+}
+
+FArchive& FMapSyncWriter::operator<<(FName& Value)
+{
+	uint64 Id = StringTable.Intern(Value);
+	FMapSyncStringTable::SerializeId(*this, Id);
+	return *this;
+}
+
+FMapSyncReader::FMapSyncReader(const TArray<uint8>& InBytes, FMapSyncStringTable& InStringTable)
+	: FMemoryReader(InBytes, true), StringTable(InStringTable)
+{
+}
+
+FArchive& FMapSyncReader::operator<<(FName& Value)
+{
+	uint64 Id = 0;
+	FMapSyncStringTable::SerializeId(*this, Id);
+	Value = StringTable.Resolve(Id);
+	return *this;
+}
+
+void FMapSyncCapture::Encode(FArchive& Ar) const
+{
+	int32 Offset = 0;
+	for (const TPair<int32, FName>& Name : Names)
+	{
+		Ar.Serialize(const_cast<uint8*>(Bytes.GetData()) + Offset, Name.Key - Offset);
+		FName Value = Name.Value;
+		Ar << Value;
+		Offset = Name.Key;
+	}
+	Ar.Serialize(const_cast<uint8*>(Bytes.GetData()) + Offset, Bytes.Num() - Offset);
+}
+
+FMapSyncCaptureWriter::FMapSyncCaptureWriter(FMapSyncCapture& InCapture)
+	: FMemoryWriter(InCapture.Bytes, true), Capture(InCapture)
+{
+}
+
+FArchive& FMapSyncCaptureWriter::operator<<(FName& Value)
+{
+	Capture.Names.Emplace(Tell(), Value);
+	return *this;
+}
@@ -0,0 +1,156 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncRecording.h"
+#include "MapSyncPrivatePCH.h"
+#include "Runtime/Core/Public/HAL/FileManager.h"
+
+TUniquePtr<FMapSyncRecorder> FMapSyncRecorder::Create(const FString& Filename, int32 ProtocolVersion, const FString& MapName)
+{
+	FArchive* Writer = IFileManager::Get().CreateFileWriter(*Filename, FILEWRITE_AllowRead);
+	if (!Writer)
+	{
+		return nullptr;
+	}
+
+	uint32 Magic = MAPSYNC_RECORDING_MAGIC;
+	int32 Version = MAPSYNC_RECORDING_VERSION;
+	FString RecordedMapName = MapName;
+	*Writer << Magic;
+	*Writer << Version;
+	*Writer << ProtocolVersion;
+	*Writer << RecordedMapName;
+	return TUniquePtr<FMapSyncRecorder>(new FMapSyncRecorder(Writer, Filename));
+}
+
+FMapSyncRecorder::FMapSyncRecorder(FArchive* InWriter, const FString& InFilename)
+	: Writer(InWriter), Filename(InFilename), StartTime(FPlatformTime::Seconds()), LastRecordMicros(0)
+{
+}
+
+FMapSyncRecorder::~FMapSyncRecorder()
+{
+	Writer.Reset();
+}
+
+void FMapSyncRecorder::RecordInbound(const FMapSyncNetInbound& Inbound)
+{
+	switch (Inbound.Event)
+	{
+	case EMapSyncNetEvent::Connected:
+		Record(EMapSyncRecordKind::Connected, Inbound.PeerId, nullptr);
+		break;
+	case EMapSyncNetEvent::Disconnected:
+		Record(EMapSyncRecordKind::Disconnected, Inbound.PeerId, nullptr);
+		break;
+	case EMapSyncNetEvent::Frame:
+		Record(EMapSyncRecordKind::Received, Inbound.PeerId, &Inbound.Payload);
+		break;
+	}
+}
+
+void FMapSyncRecorder::RecordOutbound(const FMapSyncNetOutbound& Outbound)
+{
+	// Closing, dropping, or changing the compression doesn't put anything on the wire
+	if (Outbound.Payload.Num() == 0)
+	{
+		return;
+	}
+	Record(EMapSyncRecordKind::Sent, Outbound.PeerIds.Num() > 0 ? MAPSYNC_ALL_PEERS : Outbound.PeerId, &Outbound.Payload);
+}
+
+void FMapSyncRecorder::Record(EMapSyncRecordKind Kind, int32 PeerId, const TArray<uint8>* Payload)
+{
+	// A delta bigger than what a packed int holds, over an hour without anything on the wire, is shortened
+	const uint64 RecordMicros = FMath::Max((uint64)((FPlatformTime::Seconds() - StartTime) * 1000000.0), LastRecordMicros);
+	uint32 TimeDelta = (uint32)FMath::Min<uint64>(RecordMicros - LastRecordMicros, MAX_uint32);
+	LastRecordMicros += TimeDelta;
+
+	uint8 KindByte = (uint8)Kind;
+	uint32 PackedPeerId = (uint32)(PeerId + 1);
+	*Writer << KindByte;
+	Writer->SerializeIntPacked(TimeDelta);
+	Writer->SerializeIntPacked(PackedPeerId);
+	if (Payload)
+	{
+		uint32 PayloadSize = Payload->Num();
+		Writer->SerializeIntPacked(PayloadSize);
+		Writer->Serialize(const_cast<uint8*>(Payload->GetData()), PayloadSize);
+	}
+}
+
+TUniquePtr<FMapSyncRecordingReader> FMapSyncRecordingReader::Open(const FString& Filename)
+{
+	FArchive* Reader = IFileManager::Get().CreateFileReader(*Filename, FILEREAD_AllowWrite);
+	if (!Reader)
+	{
+		return nullptr;
+	}
+
+	TUniquePtr<FMapSyncRecordingReader> Recording(new FMapSyncRecordingReader(Reader));
+	uint32 Magic = 0;
+	int32 Version = 0;
+	if (Reader->TotalSize() < (int64)(sizeof(Magic) + sizeof(Version)))
+	{
+		return nullptr;
+	}
+	*Reader << Magic;
+	*Reader << Version;
+	if (Magic != MAPSYNC_RECORDING_MAGIC || Version != MAPSYNC_RECORDING_VERSION)
+	{
+		return nullptr;
+	}
+	*Reader << Recording->ProtocolVersion;
+	*Reader << Recording->MapName;
+	if (Reader->IsError())
+	{
+		return nullptr;
+	}
+	return Recording;
+}
+
+FMapSyncRecordingReader::FMapSyncRecordingReader(FArchive* InReader)
+	: Reader(InReader), ProtocolVersion(0), LastRecordMicros(0)
+{
+}
+
+FMapSyncRecordingReader::~FMapSyncRecordingReader()
+{
+	Reader.Reset();
+}
+
+bool FMapSyncRecordingReader::Next(FMapSyncRecord& OutRecord)
+{
+	if (Reader->IsError() || Reader->AtEnd())
+	{
+		return false;
+	}
+
+	uint8 KindByte = 0;
+	uint32 TimeDelta = 0;
+	uint32 PackedPeerId = 0;
+	*Reader << KindByte;
+	Reader->SerializeIntPacked(TimeDelta);
+	Reader->SerializeIntPacked(PackedPeerId);
+	if (Reader->IsError() || KindByte > (uint8)EMapSyncRecordKind::Sent)
+	{
+		return false;
+	}
+
+	LastRecordMicros += TimeDelta;
+	OutRecord.Kind = (EMapSyncRecordKind)KindByte;
+	OutRecord.Time = LastRecordMicros / 1000000.0;
+	OutRecord.PeerId = (int32)PackedPeerId - 1;
+	OutRecord.Payload.Reset();
+	if (OutRecord.Kind == EMapSyncRecordKind::Received || OutRecord.Kind == EMapSyncRecordKind::Sent)
+	{
+		uint32 PayloadSize = 0;
+		Reader->SerializeIntPacked(PayloadSize);
+		if (Reader->IsError() || PayloadSize > MAPSYNC_MAX_FRAME_SIZE || Reader->Tell() + PayloadSize > Reader->TotalSize())
+		{
+			return false;
+		}
+		OutRecord.Payload.SetNumUninitialized(PayloadSize);
+		Reader->Serialize(OutRecord.Payload.GetData(), PayloadSize);
+	}
+	return !Reader->IsError();
+}
@@ -0,0 +1,279 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "MapSyncReplayCommandlet.h"
+#include "MapSyncPrivatePCH.h"
+#include "MapSyncEdMode.h"
+#include "MapSyncBenchmarkHelpers.h"
+#include "Runtime/Core/Public/Misc/FileHelper.h"
+#include "Editor/UnrealEd/Public/FileHelpers.h"
+#include "Runtime/CoreUObject/Public/Misc/PackageName.h"
+
+#define REPLAY_DEFAULT_SPEED 1.f // 0 replays as fast as the server takes it
+#define REPLAY_IDLE_SLEEP 0.001f // Between server ticks while waiting for the next recorded event, in seconds
+
+namespace
+{
+	struct FReplayResult
+	{
+		int32 Clients = 0; // Clients that connected during the recording
+		int32 ReplayedFrames = 0;
+		int32 SkippedFrames = 0; // Handshakes and pings, and frames of clients that connected before the recording started
+		double RecordedDuration = 0.0;
+		double ReplayDuration = 0.0;
+		int64 RecordedBytesIn = 0; // Payloads the recording server received
+		int64 RecordedBytesOut = 0; // Payloads the recording server sent, once per frame even when sent to several clients
+		int64 WireBytesIn = 0; // Sent by the loopback clients, as they went on the wire
+		int64 WireBytesOut = 0; // Received by the loopback clients
+		int32 UpdatesDelivered = 0; // Update frames received by the loopback clients
+		FMapSyncBenchmarkTicks Ticks;
+		TArray<double> Latencies; // From a client sending an update to the server acknowledging it, in seconds
+	};
+
+	// A loopback client standing for a recorded one
+	struct FReplayClient
+	{
+		FMapSyncBenchmarkClient Client;
+		int32 RecordedPeerId = INDEX_NONE;
+		int32 ServerPeerId = INDEX_NONE; // Its peer id on the replaying server
+		TArray<double> PendingUpdateTimes; // When every update the server didn't acknowledge yet was sent, in order
+
+		void Pump(FReplayResult& Result)
+		{
+			Client.Pump();
+
+			// The server acknowledges updates in the order it got them
+			for (double SequenceTime : Client.SequenceTimes)
+			{
+				if (PendingUpdateTimes.Num() > 0)
+				{
+					Result.Latencies.Add(SequenceTime - PendingUpdateTimes[0]);
+					PendingUpdateTimes.RemoveAt(0, 1, false);
+				}
+			}
+			Result.UpdatesDelivered += Client.UpdateTimes.Num();
+			Client.ResetUpdates();
+		}
+
+		// Whether everything it sent reached the server's network worker
+		bool IsReceived(FMapSyncEdMode& Server) const
+		{
+			const FMapSyncPeerDashboard* Dashboard = Server.PeerDashboards.Find(ServerPeerId);
+			if (!Dashboard || !Dashboard->Stats.IsValid() || !Client.Stats.IsValid())
+			{
+				return true; // The server closed the connection
+			}
+			return Client.Stats->QueuedBytes.GetValue() == 0 && Dashboard->Stats->BytesReceived.GetValue() >= Client.Stats->BytesSent.GetValue();
+		}
+
+		void CountWireBytes(FReplayResult& Result) const // Called before it goes away
+		{
+			if (Client.Stats.IsValid())
+			{
+				Result.WireBytesIn += Client.Stats->BytesSent.GetValue();
+				Result.WireBytesOut += Client.Stats->BytesReceived.GetValue();
+			}
+		}
+	};
+
+	// Ticks the server and the clients until IsDone returns true. Returns false if it took longer than Timeout, in seconds
+	bool TickReplayUntil(FMapSyncBenchmarkServer& Server, TArray<FReplayClient>& Clients, FReplayResult& Result, double Timeout, float SleepTime, TFunctionRef<bool()> IsDone)
+	{
+		return Server.TickUntil(Result.Ticks, Timeout, SleepTime, [&]()
+		{
+			for (FReplayClient& Client : Clients)
+			{
+				Client.Pump(Result);
+			}
+		}, IsDone);
+	}
+
+	bool ReplayRecording(FMapSyncRecordingReader& Recording, FMapSyncBenchmarkServer& Server, int32 Port, float Speed, FReplayResult& Result)
+	{
+		TArray<FReplayClient> Clients;
+		Result.Ticks.SampleBaselineMemory();
+		const double StartTime = FPlatformTime::Seconds();
+		bool bSuccess = true;
+		FMapSyncRecord Record;
+		while (bSuccess && Recording.Next(Record))
+		{
+			Result.RecordedDuration = Record.Time;
+			if (Record.Kind == EMapSyncRecordKind::Sent)
+			{
+				Result.RecordedBytesOut += Record.Payload.Num();
+				continue;
+			}
+
+			// At max speed, right after the previous event was handled
+			if (Speed > 0.f)
+			{
+				const double EventTime = StartTime + Record.Time / Speed;
+				TickReplayUntil(Server, Clients, Result, TNumericLimits<double>::Max(), REPLAY_IDLE_SLEEP, [&]()
+				{
+					return FPlatformTime::Seconds() >= EventTime;
+				});
+			}
+
+			if (Record.Kind == EMapSyncRecordKind::Connected)
+			{
+				// Clients are welcomed one at a time, so that they get the sender ids the recorded ones had
+				FReplayClient& Client = Clients[Clients.AddDefaulted()];
+				Client.RecordedPeerId = Record.PeerId;
+				Result.Clients++;
+				bSuccess = Client.Client.Connect(Port) && TickReplayUntil(Server, Clients, Result, BENCHMARK_STEP_TIMEOUT, 0.f, [&]()
+				{
+					return Client.Client.bWelcomed;
+				});
+				if (!bSuccess)
+				{
+					UE_LOG(LogMapSync, Error, TEXT("Replayed client %d couldn't join the server"), Record.PeerId);
+					break;
+				}
+				Client.ServerPeerId = Server.GetMode().Clients.Last();
+				continue;
+			}
+
+			const int32 ClientIdx = Clients.IndexOfByPredicate([&](const FReplayClient& Client) { return Client.RecordedPeerId == Record.PeerId; });
+			if (Record.Kind == EMapSyncRecordKind::Disconnected)
+			{
+				if (ClientIdx != INDEX_NONE)
+				{
+					Clients[ClientIdx].CountWireBytes(Result);
+					Clients.RemoveAt(ClientIdx);
+				}
+				continue;
+			}
+
+			Result.RecordedBytesIn += Record.Payload.Num();
+			const char Header = Record.Payload.Num() > 0 ? Record.Payload[0] : 0;
+			if (ClientIdx == INDEX_NONE || Header == HELLO_HEADER || Header == PING_HEADER || Header == PONG_HEADER)
+			{
+				Result.SkippedFrames++;
+				continue;
+			}
+
+			FReplayClient& Client = Clients[ClientIdx];
+			if (Header == UPDATE_HEADER)
+			{
+				Client.PendingUpdateTimes.Add(FPlatformTime::Seconds());
+			}
+			Client.Client.Network->Send(FMapSyncEdMode::ServerPeerId, MoveTemp(Record.Payload));
+			Result.ReplayedFrames++;
+
+			// Frames of different clients would otherwise race each other to the server
+			bSuccess = TickReplayUntil(Server, Clients, Result, BENCHMARK_STEP_TIMEOUT, 0.f, [&]()
+			{
+				return Client.IsReceived(Server.GetMode());
+			});
+			if (!bSuccess)
+			{
+				UE_LOG(LogMapSync, Error, TEXT("The server didn't receive a frame of replayed client %d, %.1f seconds into the recording"), Record.PeerId, Record.Time);
+			}
+		}
+
+		// Let the server acknowledge the last updates. Acknowledgements dropped for a lagging client never come
+		if (bSuccess && !TickReplayUntil(Server, Clients, Result, BENCHMARK_STEP_TIMEOUT, 0.f, [&]()
+		{
+			return !Clients.ContainsByPredicate([](const FReplayClient& Client) { return Client.PendingUpdateTimes.Num() > 0; });
+		}))
+		{
+			UE_LOG(LogMapSync, Warning, TEXT("Some replayed updates were never acknowledged, their latency isn't counted"));
+		}
+		Result.ReplayDuration = FPlatformTime::Seconds() - StartTime;
+
+		Server.Stop([&]()
+		{
+			for (const FReplayClient& Client : Clients)
+			{
+				Client.CountWireBytes(Result);
+			}
+			Clients.Empty();
+		});
+		return bSuccess;
+	}
+}
+
+UMapSyncReplayCommandlet::UMapSyncReplayCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMapSyncReplayCommandlet::Main(const FString& Params)
+{
+	if (!GEditor)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("MapSync replays must run in the editor"));
+		return 1;
+	}
+
+	FString RecordingPath;
+	float Speed = REPLAY_DEFAULT_SPEED;
+	FString MapName;
+	int32 Port = BENCHMARK_DEFAULT_PORT;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("MapSync") / TEXT("Replay.csv");
+	FParse::Value(*Params, TEXT("Recording="), RecordingPath);
+	FParse::Value(*Params, TEXT("Speed="), Speed);
+	FParse::Value(*Params, TEXT("Map="), MapName);
+	FParse::Value(*Params, TEXT("Port="), Port);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	Speed = FMath::Max(Speed, 0.f);
+
+	TUniquePtr<FMapSyncRecordingReader> Recording = FMapSyncRecordingReader::Open(RecordingPath);
+	if (!Recording)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("%s isn't a MapSync recording, give one with -Recording="), *RecordingPath);
+		return 1;
+	}
+	if (Recording->GetProtocolVersion() != MAPSYNC_PROTOCOL_VERSION)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("%s was recorded with protocol version %d, this editor uses version %d"), *RecordingPath, Recording->GetProtocolVersion(), MAPSYNC_PROTOCOL_VERSION);
+		return 1;
+	}
+
+	// Recorded updates are deltas against the level the session was on
+	if (MapName.IsEmpty())
+	{
+		MapName = Recording->GetMapName();
+	}
+	FString MapFilename;
+	if (!FPackageName::TryConvertLongPackageNameToFilename(MapName, MapFilename, FPackageName::GetMapPackageExtension()) || !FPaths::FileExists(MapFilename))
+	{
+		UE_LOG(LogMapSync, Error, TEXT("Unable to find level %s, give the level the session was recorded on with -Map="), *MapName);
+		return 1;
+	}
+	FEditorFileUtils::LoadMap(MapFilename, false, false);
+	UWorld* World = GEditor->GetEditorWorldContext().World();
+	if (!World || World->GetOutermost()->GetName() != MapName)
+	{
+		UE_LOG(LogMapSync, Error, TEXT("Unable to load level %s"), *MapName);
+		return 1;
+	}
+
+	FMapSyncBenchmarkServer Server;
+	if (!Server.Start(Port))
+	{
+		return 1;
+	}
+
+	UE_LOG(LogMapSync, Display, TEXT("Replaying %s on %s"), *RecordingPath, *MapName);
+	FReplayResult Result;
+	const bool bSuccess = ReplayRecording(*Recording, Server, Port, Speed, Result);
+
+	FString Csv = TEXT("Recording,Speed,Clients,RecordedSeconds,ReplaySeconds,ReplayedFrames,SkippedFrames,RecordedBytesIn,RecordedBytesOut,WireBytesIn,WireBytesOut,UpdatesDelivered,Ticks,TickTotalMs,TickMaxMs,SerializeMs,ApplyMs,LatencyP50Ms,LatencyP90Ms,LatencyP99Ms,PeakMemoryDeltaMiB\n");
+	Csv += FString::Printf(TEXT("%s,%g,%d,%.3f,%.3f,%d,%d,%lld,%lld,%lld,%lld,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n"),
+		*FPaths::GetCleanFilename(RecordingPath), Speed, Result.Clients, Result.RecordedDuration, Result.ReplayDuration, Result.ReplayedFrames, Result.SkippedFrames,
+		Result.RecordedBytesIn, Result.RecordedBytesOut, Result.WireBytesIn, Result.WireBytesOut, Result.UpdatesDelivered,
+		Result.Ticks.Count, Result.Ticks.TotalTime * 1000.0, Result.Ticks.MaxTime * 1000.0, Result.Ticks.SerializeTime * 1000.0, Result.Ticks.ApplyTime * 1000.0,
+		FMapSyncBenchmarkUtils::GetPercentile(Result.Latencies, 0.5f) * 1000.0, FMapSyncBenchmarkUtils::GetPercentile(Result.Latencies, 0.9f) * 1000.0, FMapSyncBenchmarkUtils::GetPercentile(Result.Latencies, 0.99f) * 1000.0,
+		Result.Ticks.GetPeakMemoryDelta() / (1024.0 * 1024.0));
+
+	if (!FFileHelper::SaveStringToFile(Csv, *OutputPath))
+	{
+		UE_LOG(LogMapSync, Error, TEXT("Unable to write the replay results to %s"), *OutputPath);
+		return 1;
+	}
+	UE_LOG(LogMapSync, Display, TEXT("MapSync replay results written to %s"), *OutputPath);
+	return bSuccess ? 0 : 1;
+}
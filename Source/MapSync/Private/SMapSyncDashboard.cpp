@@ -0,0 +1,145 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#include "SMapSyncDashboard.h"
+#include "MapSyncPrivatePCH.h"
+#include "MapSyncEdMode.h"
+#include "Runtime/SlateCore/Public/Rendering/DrawElements.h"
+#include "Runtime/Slate/Public/Widgets/Text/STextBlock.h"
+#include "Runtime/SlateCore/Public/Widgets/SBoxPanel.h"
+#include "Editor/EditorStyle/Public/EditorStyleSet.h"
+
+#define LOCTEXT_NAMESPACE "SMapSyncDashboard"
+
+void SMapSyncHistoryGraph::Construct(const FArguments& InArgs)
+{
+	History = InArgs._History;
+}
+
+int32 SMapSyncHistoryGraph::OnPaint(const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect, FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled) const
+{
+	FSlateDrawElement::MakeBox(OutDrawElements, LayerId, AllottedGeometry.ToPaintGeometry(), FEditorStyle::GetBrush("WhiteBrush"), ESlateDrawEffect::None, FLinearColor(0.f, 0.f, 0.f, 0.3f));
+
+	const FMapSyncHistory* Samples = History.Get();
+	if (!Samples || Samples->Num() < 2)
+	{
+		return LayerId + 1;
+	}
+
+	// Newest sample on the right, so that the graph scrolls left as samples come
+	const FVector2D Size = AllottedGeometry.GetLocalSize();
+	const float Max = FMath::Max(Samples->GetMax(), 1.f);
+	TArray<FVector2D> Points;
+	for (int32 i = 0; i < Samples->Num(); i++)
+	{
+		const float X = Size.X * (DASHBOARD_HISTORY_SIZE - Samples->Num() + i) / (DASHBOARD_HISTORY_SIZE - 1);
+		const float Y = Size.Y * (1.f - (*Samples)[i] / Max);
+		Points.Add(FVector2D(X, Y));
+	}
+	FSlateDrawElement::MakeLines(OutDrawElements, LayerId + 1, AllottedGeometry.ToPaintGeometry(), Points, ESlateDrawEffect::None, FLinearColor::Green, true, 1.f);
+	return LayerId + 1;
+}
+
+FVector2D SMapSyncHistoryGraph::ComputeDesiredSize(float LayoutScaleMultiplier) const
+{
+	return FVector2D(DASHBOARD_HISTORY_SIZE * 3.f, 32.f);
+}
+
+void SMapSyncDashboard::Construct(const FArguments& InArgs)
+{
+	EdMode = InArgs._EdMode;
+
+	ChildSlot
+	[
+		SAssignNew(Rows, SVerticalBox)
+	];
+	RebuildRows();
+}
+
+void SMapSyncDashboard::Tick(const FGeometry& AllottedGeometry, const double InCurrentTime, const float InDeltaTime)
+{
+	SCompoundWidget::Tick(AllottedGeometry, InCurrentTime, InDeltaTime);
+
+	FMapSyncEdMode* Mode = EdMode.Get();
+	TArray<int32> PeerIds;
+	if (Mode)
+	{
+		Mode->PeerDashboards.GenerateKeyArray(PeerIds);
+		PeerIds.Sort();
+	}
+	if (PeerIds != ShownPeerIds)
+	{
+		ShownPeerIds = MoveTemp(PeerIds);
+		RebuildRows();
+	}
+}
+
+void SMapSyncDashboard::RebuildRows()
+{
+	Rows->ClearChildren();
+	if (ShownPeerIds.Num() == 0)
+	{
+		Rows->AddSlot()
+		.AutoHeight()
+		[
+			SNew(STextBlock)
+			.Text(LOCTEXT("NoPeer", "Not connected to anyone"))
+		];
+		return;
+	}
+
+	for (int32 PeerId : ShownPeerIds)
+	{
+		Rows->AddSlot()
+		.AutoHeight()
+		.Padding(FMargin(0.f, 4.f))
+		[
+			SNew(SVerticalBox)
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			[
+				SNew(STextBlock)
+				.Text_Lambda([this, PeerId]()
+				{
+					return GetPeerText(PeerId);
+				})
+				.AutoWrapText(true)
+			]
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			.HAlign(HAlign_Left)
+			[
+				SNew(SMapSyncHistoryGraph)
+				.History_Lambda([this, PeerId]() -> const FMapSyncHistory*
+				{
+					FMapSyncEdMode* Mode = EdMode.Get();
+					const FMapSyncPeerDashboard* Dashboard = Mode ? Mode->PeerDashboards.Find(PeerId) : nullptr;
+					return Dashboard ? &Dashboard->Throughput : nullptr;
+				})
+			]
+		];
+	}
+}
+
+FText SMapSyncDashboard::GetPeerText(int32 PeerId) const
+{
+	FMapSyncEdMode* Mode = EdMode.Get();
+	const FMapSyncPeerDashboard* Dashboard = Mode ? Mode->PeerDashboards.Find(PeerId) : nullptr;
+	if (!Dashboard)
+	{
+		return FText::GetEmpty();
+	}
+
+	const FString PeerName = Mode->bBound ? FString::Printf(TEXT("Client %d"), PeerId) : FString(TEXT("Server"));
+	const FString Rtt = Dashboard->Rtt >= 0.f ? FString::Printf(TEXT("%.1f ms"), Dashboard->Rtt * 1000.f) : FString(TEXT("?"));
+	const int64 QueuedBytes = Dashboard->Stats.IsValid() ? Dashboard->Stats->QueuedBytes.GetValue() : 0;
+	FString Text = FString::Printf(TEXT("%s - in: %s/s, out: %s/s, RTT: %s, queued: %s, has update %u (we have %u)"),
+		*PeerName, *FText::AsMemory(static_cast<uint64>(Dashboard->BytesInPerSec)).ToString(), *FText::AsMemory(static_cast<uint64>(Dashboard->BytesOutPerSec)).ToString(), *Rtt,
+		*FText::AsMemory(static_cast<uint64>(QueuedBytes)).ToString(), Dashboard->Seq, Mode->GetLocalSeq());
+	if (Dashboard->ResyncProgress >= 0.f)
+	{
+		Text += FString::Printf(TEXT(", resync: %d%%"), FMath::RoundToInt(Dashboard->ResyncProgress * 100.f));
+	}
+	return FText::FromString(Text);
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,52 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/SlateCore/Public/Widgets/SCompoundWidget.h"
+#include "Runtime/SlateCore/Public/Widgets/SLeafWidget.h"
+
+class FMapSyncEdMode;
+class FMapSyncHistory;
+class SVerticalBox;
+
+// Line graph of a history, scaled to its highest sample
+class SMapSyncHistoryGraph : public SLeafWidget
+{
+public:
+	SLATE_BEGIN_ARGS(SMapSyncHistoryGraph)
+	{
+	}
+	SLATE_ATTRIBUTE(const FMapSyncHistory*, History)
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs);
+
+	virtual int32 OnPaint(const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect, FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled) const override;
+	virtual FVector2D ComputeDesiredSize(float LayoutScaleMultiplier) const override;
+
+private:
+	TAttribute<const FMapSyncHistory*> History;
+};
+
+// One line of figures and a throughput graph per peer, the clients when hosting, the server when connected to one
+class SMapSyncDashboard : public SCompoundWidget
+{
+public:
+	SLATE_BEGIN_ARGS(SMapSyncDashboard)
+	{
+	}
+	SLATE_ATTRIBUTE(FMapSyncEdMode*, EdMode)
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs);
+
+	virtual void Tick(const FGeometry& AllottedGeometry, const double InCurrentTime, const float InDeltaTime) override;
+
+private:
+	void RebuildRows(); // Called when peers come and go, figures are then read on every paint
+	FText GetPeerText(int32 PeerId) const;
+
+	TAttribute<FMapSyncEdMode*> EdMode;
+	TSharedPtr<SVerticalBox> Rows;
+	TArray<int32> ShownPeerIds;
+};
@@ -4,6 +4,7 @@
 #include "Runtime/Engine/Classes/GameFramework/Actor.h"
 #include "CustomSerialization.generated.h"
 
+struct FMapSyncCapture;
 
 UCLASS()
 class UCustomSerializer : public UObject
@@ -12,6 +13,17 @@ class UCustomSerializer : public UObject
 public:
 	virtual TSubclassOf<UObject> GetSupportedClass() const;
 	virtual void MapSyncSerialize(FArchive& Ar, UObject* Obj) const;
+
+	// Same as MapSyncSerialize, but only writes the fields that differ from BaselineAr, a state previously written by MapSyncSerialize, behind a change mask
+	// When loading, or when the receiver has no state for the object yet, BaselineAr is null: every field is then written, and only present fields are applied
+	// Only called when the object's state differs from the baseline. By default, writes the whole state
+	virtual void MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const;
+
+	// Full states (resyncs) are built in two steps, so that most of the work runs on worker threads
+	// Capture reads the object into plain data, on the game thread. By default, captures what MapSyncSerialize writes
+	virtual void MapSyncCapture(FMapSyncCapture& OutCapture, UObject* Obj) const;
+	// Encode writes the same bytes as MapSyncSerialize from the capture alone, on any thread: it must not access any UObject
+	virtual void MapSyncEncode(FArchive& Ar, const FMapSyncCapture& Capture) const;
 };
 
 UCLASS()
@@ -21,6 +33,7 @@ class UCustomSerializerActor : public UCustomSerializer
 public:
 	virtual TSubclassOf<UObject> GetSupportedClass() const override;
 	virtual void MapSyncSerialize(FArchive& Ar, UObject* Obj) const override;
+	virtual void MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const override;
 };
 
 UCLASS()
@@ -30,6 +43,7 @@ class UCustomSerializerSMActor : public UCustomSerializer
 public:
 	virtual TSubclassOf<UObject> GetSupportedClass() const override;
 	virtual void MapSyncSerialize(FArchive& Ar, UObject* Obj) const override;
+	virtual void MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const override;
 };
 
 UCLASS()
@@ -39,4 +53,5 @@ class UCustomSerializerLightActor : public UCustomSerializer
 public:
 	virtual TSubclassOf<UObject> GetSupportedClass() const override;
 	virtual void MapSyncSerialize(FArchive& Ar, UObject* Obj) const override;
+	virtual void MapSyncSerializeDelta(FArchive& Ar, FArchive* BaselineAr, UObject* Obj) const override;
 };
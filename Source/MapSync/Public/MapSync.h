@@ -4,10 +4,84 @@
 
 #include "Runtime/Core/Public/Modules/ModuleManager.h"
 #include "Editor/UnrealEd/Public/Features/IPluginsEditorFeature.h"
+#include "Runtime/Core/Public/Stats/Stats.h"
+#include "Runtime/Core/Public/ProfilingDebugging/CpuProfilerTrace.h"
+#include "Runtime/Core/Public/HAL/ThreadSafeCounter64.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(LogMapSync, Log, All);
 DECLARE_LOG_CATEGORY_EXTERN(LogMapSyncDebug, Log, All);
 
+// Shown by stat MapSync
+DECLARE_STATS_GROUP(TEXT("MapSync"), STATGROUP_MapSync, STATCAT_Advanced);
+
+// Phases of the sync loop, and of the network worker
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update"), STAT_MapSyncUpdate, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Receive"), STAT_MapSyncReceive, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode"), STAT_MapSyncDecode, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Apply"), STAT_MapSyncApply, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Detect changes"), STAT_MapSyncDetectChanges, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Send"), STAT_MapSyncSend, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Resync"), STAT_MapSyncResync, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Snapshot"), STAT_MapSyncSnapshot, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Compress"), STAT_MapSyncCompress, STATGROUP_MapSync, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decompress"), STAT_MapSyncDecompress, STATGROUP_MapSync, );
+
+// Traffic and work, per frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes in"), STAT_MapSyncBytesIn, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes out"), STAT_MapSyncBytesOut, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Frames in"), STAT_MapSyncFramesIn, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Frames out"), STAT_MapSyncFramesOut, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Create commands"), STAT_MapSyncCreateCommands, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Remove commands"), STAT_MapSyncRemoveCommands, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Update commands"), STAT_MapSyncUpdateCommands, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Rename commands"), STAT_MapSyncRenameCommands, STATGROUP_MapSync, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Actors serialized"), STAT_MapSyncActorsSerialized, STATGROUP_MapSync, );
+
+// Queue depths, as of the last update
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Dirty actors"), STAT_MapSyncDirtyActors, STATGROUP_MapSync, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Received frames waiting"), STAT_MapSyncReceivedFrames, STATGROUP_MapSync, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Resyncs streaming"), STAT_MapSyncResyncJobs, STATGROUP_MapSync, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Queued for the slowest peer"), STAT_MapSyncQueuedBytes, STATGROUP_MapSync, );
+
+// Same phases, for FMapSyncPhaseScope
+enum class EMapSyncPhase : uint8
+{
+	Update,
+	Receive,
+	Decode,
+	Apply,
+	DetectChanges,
+	Send,
+	Resync,
+	Snapshot,
+	Compress,
+	Decompress,
+	Count,
+};
+
+// Adds the cycles spent in its scope to its phase. Counted whether stats are enabled or not, so that the benchmark commandlets can split their tick times
+class FMapSyncPhaseScope
+{
+public:
+	explicit FMapSyncPhaseScope(EMapSyncPhase InPhase) : Phase(InPhase), StartCycles(FPlatformTime::Cycles64()) {}
+	~FMapSyncPhaseScope() { Cycles[(int32)Phase].Add(FPlatformTime::Cycles64() - StartCycles); }
+
+	// Since the module started, on every thread
+	static int64 GetCycles(EMapSyncPhase Phase) { return Cycles[(int32)Phase].GetValue(); }
+
+private:
+	static FThreadSafeCounter64 Cycles[(int32)EMapSyncPhase::Count];
+
+	EMapSyncPhase Phase;
+	uint64 StartCycles;
+};
+
+// Times a phase in stat MapSync, in Unreal Insights, and in FMapSyncPhaseScope
+#define MAPSYNC_SCOPE_CYCLE_COUNTER(Phase) \
+	SCOPE_CYCLE_COUNTER(STAT_MapSync##Phase); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(MapSync##Phase); \
+	FMapSyncPhaseScope MapSyncPhaseScope##Phase(EMapSyncPhase::Phase)
+
 class FMapSyncModule : public IModuleInterface, public IPluginsEditorFeature
 {
 public:
@@ -0,0 +1,44 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/CoreUObject/Public/UObject/WeakObjectPtr.h"
+#include "Runtime/Core/Public/Misc/Optional.h"
+
+class AActor;
+class UWorld;
+class AStaticMeshActor;
+class UStaticMesh;
+class UMaterialInterface;
+
+/*
+ * Changes received for actors, only applied once every frame received in a tick was read
+ * While dragging, peers send a new transform on every tick, and several of them may arrive at once: only the latest value of each field is applied
+ * Each actor is then changed once: its mesh and materials together, and its whole transform in a single call. Navigation is only updated once, for the whole batch
+ */
+class FMapSyncApplyBatch
+{
+public:
+	static FMapSyncApplyBatch& Get();
+
+	void SetActorLocation(AActor* Actor, const FVector& Location);
+	void SetActorRotation(AActor* Actor, const FRotator& Rotation);
+	void SetActorScale3D(AActor* Actor, const FVector& Scale);
+	void SetStaticMesh(AStaticMeshActor* Actor, UStaticMesh* StaticMesh);
+	void SetMaterial(AStaticMeshActor* Actor, int32 Slot, UMaterialInterface* Material);
+
+	void Flush(UWorld* World, TSet<TWeakObjectPtr<AActor>>& OutAppliedActors); // Applies the latest changes of every actor, and adds them to OutAppliedActors
+	void Discard();
+
+private:
+	struct FPendingChanges
+	{
+		TOptional<FVector> Location;
+		TOptional<FRotator> Rotation;
+		TOptional<FVector> Scale;
+		TWeakObjectPtr<UStaticMesh> StaticMesh;
+		TMap<int32, TWeakObjectPtr<UMaterialInterface>> Materials; // By slot
+	};
+
+	TMap<TWeakObjectPtr<AActor>, FPendingChanges> PendingChanges;
+};
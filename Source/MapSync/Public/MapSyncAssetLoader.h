@@ -0,0 +1,44 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/CoreUObject/Public/UObject/SoftObjectPath.h"
+#include "Runtime/CoreUObject/Public/UObject/WeakObjectPtr.h"
+#include "Runtime/Core/Public/Templates/Function.h"
+
+struct FStreamableHandle;
+
+/*
+ * Loads the assets received actors reference (meshes, materials...) without blocking the editor
+ * Serializers request an asset for a target and a slot, and give what to do with it. If the asset is already loaded, it's applied right away
+ * Otherwise, every asset requested while applying a frame is loaded in a single async request, when the frame is done, and applied once loaded
+ * Only the last request for a target and a slot is applied, so that a slow load never overrides a newer assignment
+ */
+class FMapSyncAssetLoader
+{
+public:
+	typedef TFunction<void(UObject*)> FOnAssetLoaded;
+
+	static FMapSyncAssetLoader& Get();
+
+	void RequestAsset(const FName& AssetPath, UObject* Target, const FName& Slot, FOnAssetLoaded&& OnLoaded);
+	void FlushRequests(); // Starts loading every asset requested since the last flush
+
+private:
+	struct FPendingAssignment
+	{
+		FName AssetPath;
+		TWeakObjectPtr<UObject> Target;
+		FOnAssetLoaded OnLoaded;
+	};
+
+	UObject* FindLoadedAsset(const FName& AssetPath);
+	void OnBatchLoaded(TArray<FName> AssetPaths, int32 HandleId);
+
+	TMap<TPair<TWeakObjectPtr<UObject>, FName>, FPendingAssignment> PendingAssignments; // By target and slot
+	TArray<FSoftObjectPath> BatchPaths; // Requested since the last flush
+	TArray<FName> BatchNames;
+	TMap<FName, TWeakObjectPtr<UObject>> ResolvedAssets; // Soft path -> asset, for assets already loaded
+	TMap<int32, TSharedPtr<FStreamableHandle>> ActiveHandles; // Kept until their load completes
+	int32 NextHandleId = 0;
+};
@@ -0,0 +1,27 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Engine/Classes/Commandlets/Commandlet.h"
+#include "MapSyncBenchmarkCommandlet.generated.h"
+
+/*
+ * Headless benchmark of the whole sync pipeline, so that regressions can be tracked
+ * For each level size, builds a synthetic level of static meshes, lights and blueprint actors, runs a MapSync server on it, and connects loopback clients on 127.0.0.1
+ * Blueprint actors are of the given blueprint class, or of a blueprint of static mesh actor created for the run
+ * Clients speak the protocol directly instead of being full editors, as they would share the server's level otherwise. They only answer the welcome, and echo updates back when asked to
+ * Workloads: Resync (clients joining), Move (every actor moved at once), Paste (actors added), Delete (those actors removed), Echo (the server applying a client's update)
+ * For each workload, writes server tick times, with the serialize and apply parts, bytes on the wire, end to end latency percentiles and how much memory use grew to a CSV
+ *
+ * UE4Editor-Cmd.exe Project.uproject -run=MapSyncBenchmark [-Actors=1000,10000,100000] [-Clients=4] [-Iterations=10] [-Port=8990] [-Blueprint=/Game/BP_Actor.BP_Actor_C] [-Output=Bench.csv]
+ */
+UCLASS()
+class UMapSyncBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UMapSyncBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
+
@@ -0,0 +1,52 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Core/Public/Templates/UniquePtr.h"
+
+class FArchive;
+
+/*
+ * Server side log of the last numbered update frames, so that a client reconnecting after a short drop only gets what it missed
+ * Frames are kept in a ring buffer up to a size in memory. The oldest ones are then either forgotten, or spilled to a file up to another size
+ * When the file is full, it starts over, forgetting every spilled frame
+ */
+class FMapSyncChangeLog
+{
+public:
+	FMapSyncChangeLog();
+	~FMapSyncChangeLog();
+
+	void Reset(int64 InMemorySize, int64 InSpillSize, const FString& InSpillFilename); // A spill size of 0 disables spilling
+
+	void Add(uint32 Seq, const TArray<uint8>& Frame); // Seq must follow the last added one
+	uint32 GetLastSeq() const { return LastSeq; }
+
+	// Gets every frame after Seq, in order. Returns false if some of them aren't logged anymore
+	bool GetFramesAfter(uint32 Seq, TArray<TArray<uint8>>& OutFrames);
+
+private:
+	struct FEntry
+	{
+		uint32 Seq = 0;
+		TArray<uint8> Frame;
+	};
+
+	FEntry& At(int32 Idx) { return Ring[(Head + Idx) % Ring.Num()]; }
+	void Push(FEntry&& Entry);
+	FEntry Pop();
+	void Spill(const FEntry& Entry);
+	void CloseSpillFile();
+
+	TArray<FEntry> Ring;
+	int32 Head; // Oldest entry
+	int32 Count;
+	int64 MemoryBytes; // Size of the frames in the ring
+	int64 MemorySize;
+	uint32 LastSeq;
+
+	FString SpillFilename;
+	int64 SpillSize;
+	TUniquePtr<FArchive> SpillWriter;
+	TArray<TPair<uint32, int64>> SpillIndex; // Seq -> offset in the file, of every spilled frame
+};
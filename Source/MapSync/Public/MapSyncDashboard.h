@@ -0,0 +1,54 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "MapSyncNetwork.h"
+
+#define DASHBOARD_HISTORY_SIZE 60 // Samples kept for the history graphs
+#define DASHBOARD_SAMPLE_INTERVAL 1.0 // Seconds between two samples, peers are pinged as often
+
+// Fixed size ring buffer of the last samples of a value
+class FMapSyncHistory
+{
+public:
+	FMapSyncHistory() : Head(0), Count(0) { Samples.SetNumZeroed(DASHBOARD_HISTORY_SIZE); }
+
+	void Add(float Sample)
+	{
+		Samples[Head] = Sample;
+		Head = (Head + 1) % Samples.Num();
+		Count = FMath::Min(Count + 1, Samples.Num());
+	}
+
+	int32 Num() const { return Count; }
+	float operator[](int32 Idx) const { return Samples[(Head - Count + Idx + Samples.Num()) % Samples.Num()]; } // 0 is the oldest sample
+
+	float GetMax() const
+	{
+		float Max = 0.f;
+		for (int32 i = 0; i < Count; i++)
+		{
+			Max = FMath::Max(Max, (*this)[i]);
+		}
+		return Max;
+	}
+
+private:
+	TArray<float> Samples;
+	int32 Head; // Where the next sample goes
+	int32 Count;
+};
+
+// What the toolkit shows about a peer, as seen from this editor
+struct FMapSyncPeerDashboard
+{
+	FMapSyncPeerStatsPtr Stats;
+	int64 LastBytesIn = 0; // As of the last sample
+	int64 LastBytesOut = 0;
+	float BytesInPerSec = 0.f;
+	float BytesOutPerSec = 0.f;
+	float Rtt = -1.f; // In seconds, negative until the peer answered a ping
+	uint32 Seq = 0; // Last update the peer has everything up to, as of its last pong
+	float ResyncProgress = -1.f; // Between 0 and 1 while the peer is being resynced, negative otherwise
+	FMapSyncHistory Throughput; // Bytes per second, both ways
+};
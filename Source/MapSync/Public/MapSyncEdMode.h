@@ -6,17 +6,36 @@
 #include "Editor/UnrealEd/Public/UnrealEd.h" 
 #include "Editor/UnrealEd/Public/Editor.h"
 #include "Runtime/Networking/Public/Networking.h"
+#include "MapSyncNetwork.h"
+#include "MapSyncProtocol.h"
+#include "MapSyncChangeLog.h"
+#include "MapSyncDashboard.h"
+#include "MapSyncRecording.h"
 
 #include <functional>
 #include <chrono>
 
 #define MAPSYNC_INI FPaths::ProjectPluginsDir() + TEXT("MapSync/Config/MapSync.ini")
 
-#define UPDATE_DELAY 0.1f
+#define TICK_DEFAULT_MODE TEXT("Adaptive") // Default of TickMode in MapSync.ini: Fixed sends local changes every SendInterval, Adaptive depends on whether actors are being edited
+#define SEND_DEFAULT_INTERVAL 100.f // Default of SendInterval in MapSync.ini, in milliseconds
+#define SEND_DEFAULT_ACTIVE_INTERVAL 0.f // Default of ActiveSendInterval in MapSync.ini, in milliseconds, used while actors are being edited. 0 sends on every editor tick
+#define SEND_DEFAULT_IDLE_INTERVAL 250.f // Default of IdleSendInterval in MapSync.ini, in milliseconds, used otherwise
 
+#define MAPSYNC_PROTOCOL_VERSION 7
+
+#define HELLO_HEADER 'h'
+#define WELCOME_HEADER 'w'
+#define STRINGS_HEADER 's'
 #define RESYNC_HEADER 'r'
+#define RESYNCBEGIN_HEADER 'b'
+#define RESYNCEND_HEADER 'd'
 #define UPDATE_HEADER 'e'
 #define EXIT_HEADER 'x'
+#define SEQUENCE_HEADER 'q'
+#define SYNCED_HEADER 'y'
+#define PING_HEADER 'p'
+#define PONG_HEADER 'o'
 
 #define CREATE_CMD 'c'
 #define REMOVE_CMD 'r'
@@ -26,21 +45,58 @@
 #define BPCLASS_CREATEFLAG 'b'
 #define CPPCLASS_CREATEFLAG 'c'
 
+#define MAX_ACTOR_SERIALIZERS 32 // Serializers applying to an actor are flagged in a 32 bits mask
+
+#define COMPRESSION_DEFAULT_FORMAT TEXT("Zlib") // Default of CompressionFormat in MapSync.ini, None disables compression
+#define COMPRESSION_DEFAULT_THRESHOLD 1024 // Default of CompressionThreshold in MapSync.ini, in bytes
+
+#define CLIENT_QUEUE_DEFAULT_HIGH_WATER 16384 // Default of ClientQueueHighWater in MapSync.ini, in KiB. Above it, a client's updates are coalesced
+#define CLIENT_DEFAULT_MAX_LAG_TIME 10.f // Default of ClientMaxLagTime in MapSync.ini, in seconds
+
+#define APPLY_DEFAULT_BUDGET 8.f // Default of ApplyBudget in MapSync.ini, in milliseconds per tick. 0 applies everything received at once
+
+#define DRAG_QUEUE_THRESHOLD (64 * 1024) // Above this many bytes waiting to be sent, dragged actors are sent less often
+#define DRAG_MIN_BACKOFF_INTERVAL 0.05f // Once the link fills up, dragged actors are sent at least this far apart, in seconds
+#define DRAG_MAX_SEND_INTERVAL 0.5f // At worst, dragged actors are sent this often, in seconds
+#define DRAG_SLOW_CHANGE_RATE 100.f // Below this many units, degrees or percents of scale per second, a drag is slow, and sent less often
+#define DRAG_SLOW_SEND_INTERVAL 0.1f // Slow drags are sent at least this far apart, in seconds
+
+#define RESYNC_CHUNK_SIZE (256 * 1024) // Resyncs are streamed in chunks of about this size, in bytes
+#define RESYNC_DEFAULT_WINDOW_SIZE 4096 // Default of ResyncWindowSize in MapSync.ini, in KiB
+
+#define CHANGELOG_DEFAULT_SIZE 32768 // Default of ChangeLogSize in MapSync.ini, in KiB. Updates kept in memory for reconnecting clients
+#define CHANGELOG_DEFAULT_SPILL_SIZE 0 // Default of ChangeLogSpillSize in MapSync.ini, in KiB. Older updates kept on disk, 0 disables it
+
+#define RECORD_DEFAULT_SESSION false // Default of RecordSession in MapSync.ini. Servers then record their session to Saved/MapSync/Recordings, to be replayed by the MapSyncReplay commandlet
+
 // #define INITIALBUNCH_HEADER 'i'
 // #define TICKBUNCH_HEADER 't'
 
 class FMapSyncEdMode;
 class FPackage;
 class UCustomSerializer;
+class SNotificationItem;
 
 /*
  * The class handling the editor mode of MapSync
  * Also contains most of the logic behind, there was no point in putting it inside another file
- * The structure of the sent data is [COMMAND][NAMESIZE][NAME][DATASIZE][DATA], and all modifications are concatenated. The command is 1 byte, the sizes are 4 bytes long
- * At the message's beginning, there is the level name, and the same of the string just before it: [LEVELNAMESIZE][LEVELNAME]
+ * The structure of the sent data is [COMMAND][NAME][DATASIZE][DATA], and all modifications are concatenated. The command is 1 byte, the data size is a varint
+ * At the message's beginning, there is the level name: [LEVELNAME]
+ * An update's data is a delta against the last state peers agreed on: [SERIALIZERMASK], then for each flagged serializer, its changed fields behind its own change mask
+ * Names, class paths and asset paths are string table ids (see FMapSyncStringTable), defined beforehand by [STRINGS_HEADER][STRINGS] messages
+ * When a client connects, the server sends [WELCOME_HEADER][PROTOCOLVERSION][SENDERID][SESSIONGUID][COMPRESSIONFORMAT][COMPRESSIONFLAGS][STRINGS]
+ * The client answers [HELLO_HEADER][PROTOCOLVERSION][COMPRESSIONFORMAT][SESSIONGUID][LASTSEQ], the format being None if it doesn't accept the server's one
+ * Updates the server sends are numbered: [UPDATE_HEADER][SEQ], 0 meaning unnumbered. The client that sent an update only gets [SEQUENCE_HEADER][SEQ]
+ * [SYNCED_HEADER][SEQ] tells a client it has every update up to SEQ, after a resync or coalesced updates
+ * A client reconnecting to the same session sends the last SEQ it has everything up to, and only gets the updates after it, if the server still has them
+ * A resync is streamed: [RESYNCBEGIN_HEADER][ACTORCOUNT], then as many [RESYNC_HEADER][ACTORS] chunks as needed, then [RESYNCEND_HEADER]
+ * The server streams one to every client that joins, interleaved with the live updates, so that the client is up to date once it ends
+ * Both sides regularly send [PING_HEADER][TIME], answered by [PONG_HEADER][TIME][SEQ], SEQ being the last update the answering side has. It gives the round trip time, and how far behind the other side is
  */
 class FMapSyncEdMode : public FEdMode
 {
+	friend class UMapSyncMicroBenchmarkCommandlet; // Times the private hot paths
+
 public:
 	static const FEditorModeID EM_MapSyncEdModeId; // Use for EdMode
 	static bool bIsMapSyncSerialization;
@@ -56,49 +112,220 @@ public:
 	bool UsesToolkits() const override; // Requiered to use a toolkit, i.e. a GUI in the EdMode panel
 	void UpdateToolkit(int32 UIMode);
 
+// TCP related stuff, all sockets are owned by the network worker, which runs on its own thread
+public:
+	TUniquePtr<FMapSyncNetworkWorker> Network;
+
+// Protocol related stuff
+private:
+	FMapSyncStringTable StringTable; // Strings shared by the whole session
+	bool bWelcomed; // Client side, whether the server sent us our sender id
+	uint32 NextClientSenderId; // Server side, sender id to give to the next client
+	TSet<int32> HelloedClients; // Server side, clients that said hello with the right protocol version
+	void SendFrame(int32 PeerId, TArray<uint8>&& Frame, int32 ExceptPeerId = INDEX_NONE, bool bDroppable = false); // Sends the strings the frame may use, then the frame
+	void FlushPendingStrings();
+	void SendWelcome(int32 ClientId);
+	void SendHello(FName CompressionFormat);
+	FMapSyncCompressionSettings CompressionSettings; // What this editor wants, from MapSync.ini. What is used is negotiated for each connection
+	void LoadCompressionSettings();
+
+	// Update numbering, so that a client reconnecting after a short drop only gets what it missed
+	FGuid SessionGuid; // Server side, identifies this server session. Client side, the session LastAppliedSeq belongs to
+	uint32 LastSeq; // Server side, number of the last update broadcast
+	uint32 LastAppliedSeq; // Client side, number of the last update we have every update up to
+	FMapSyncChangeLog ChangeLog; // Server side, last updates broadcast
+	void ApplySequence(uint32 Seq); // Client side, counts a numbered update as applied if it's the next one
+	void SendSynced(int32 ClientId); // Tells the client it has every update so far, unless it's still missing some
+	bool CatchUpClient(int32 ClientId, const FGuid& ClientSessionGuid, uint32 ClientLastSeq); // Sends the updates the client missed, if they're still logged
+
 // TCP client related stuff
 public:
-	FSocket* ConnectionToServer; // The socket handling connection to server
+	static const int32 ServerPeerId = 0; // When connected to a server, the server is the network worker's only peer
 	FIPv4Address ServerAdress;// The server adress, in the UE4 adress form
 	bool bConnectedToServer;// Wether it's connected
 	void ConnectToServerAdress(const FString& ServerAdress); // Function to set server adress from a string
 	void ResyncClient();
 
+	// Received frames are applied within a time budget on every tick, so that the editor stays responsive while a big change streams in
+	TArray<TArray<uint8>> ReceivedFrames; // Not fully applied yet, in order
+	int64 ReceivedFrameOffset; // Where to resume in the first one, 0 if it wasn't started
+	float ApplyBudget; // In seconds, 0 means no limit
+	bool ApplyReceivedFrames(bool bWithinBudget); // Returns false if we have to leave the server
+
 // TCP server related stuff
 public:
-	FSocket* ServerBind; // The socket handling port binding
-	TArray<FSocket*> Clients;
-	FIPv4Address ThisServerAdress;// The server adress, in the UE4 adress form
+	TArray<int32> Clients; // Network worker peer ids of the connected clients
 	bool bBound;// Wether it's connected
-	void BindToPort(int32 Port);
+	void BindToPort(int32 Port, bool bAllowRecording = true); // Without bAllowRecording, the session isn't recorded whatever RecordSession says
+
+// Main loop related stuff. Received data is handled on the editor tick right after it arrived, local changes are sent at the configured cadence
+private:
+	FDelegateHandle PostEditorTickHandle;
+	double LastUpdateTime;
+	bool bAdaptiveTick;
+	float SendInterval; // In seconds, in Fixed mode
+	float ActiveSendInterval; // In seconds, in Adaptive mode while actors are being edited
+	float IdleSendInterval; // In seconds, in Adaptive mode otherwise
+	void LoadTickSettings();
+	void OnPostEditorTick(float DeltaTime);
+	float GetSendInterval() const;
+	bool ReceiveFromServer(); // Queues what the server sent to be applied, returns false if it disconnected
+	void ReceiveFromClients(); // Handles connections, disconnections, and what clients sent
 
 public:
-	bool bTimerLambdaSet;
-	float AccTimeSinceLastCall;
 	void Cancel();
 	void UpdateMapSync();
-	void ResyncToClient(int32 ClientIdx);
-	void DeserializeResync(FMemoryReader& Ar);
+	void ResyncToClient(int32 ClientId); // Starts streaming a resync to the client
+	int32 DeserializeResync(FMemoryReader& Ar, double EndTime = 0.0); // Applies one resync chunk, until EndTime if given, returns how many actors it applied
+
+// Dashboard related stuff, shown by the toolkit
+public:
+	TMap<int32, FMapSyncPeerDashboard> PeerDashboards; // By network worker peer id: the clients when we're the server, the server when we're a client
+	uint32 GetLocalSeq() const { return bBound ? LastSeq : LastAppliedSeq; } // Last update we have everything up to
+private:
+	double LastDashboardSampleTime;
+	void TickDashboard(); // Samples every peer's figures, and pings it, once every DASHBOARD_SAMPLE_INTERVAL
+	void SendPing(int32 PeerId);
+	void OnPingFrame(int32 PeerId, const TArray<uint8>& Frame); // Answers a ping, or reads a pong
+
+// Recording related stuff, server side
+public:
+	bool StartRecording(const FString& Filename); // Records every network event from now on, so that the session can be replayed. Returns false if the file couldn't be created
+	void StopRecording();
+	bool IsRecording() const { return Recorder.IsValid(); }
+private:
+	TUniquePtr<FMapSyncRecorder> Recorder;
+
+// Resync related stuff
+private:
+	struct FResyncJob
+	{
+		int32 ClientId;
+		TArray<FName> Actors; // Snapshot actors to send, gathered when the resync was asked
+		int32 NextActorIdx;
+	};
+	TArray<FResyncJob> ResyncJobs; // Server side, resyncs being streamed to clients
+	int64 ResyncWindowSize; // Server side, maximum resync bytes waiting to be sent to a client, in bytes. Caps the memory a resync uses
+	void TickResyncJobs(); // Sends the next chunks of every resync, as long as their client keeps up
+
+	int32 ResyncActorsTotal; // Client side, how many actors the server announced
+	int32 ResyncActorsApplied; // Client side, how many actors were received so far
+	TWeakPtr<SNotificationItem> ResyncNotification; // Client side, shows the resync progress
+	void UpdateResyncProgress(bool bFinished);
+
+// Snapshot related stuff, server side
+private:
+	struct FSnapshotActor
+	{
+		TArray<uint8> Header; // [NAME][CREATEFLAG][CLASSPATH]
+		TArray<uint8> State; // Full state, as written by MapSyncSerialize
+	};
+	TMap<FName, FSnapshotActor> Snapshot; // Encoded state of every synced actor, kept up to date with what is broadcast. Resyncs are streamed from it
+	void BuildSnapshot(); // Captures the whole level, once when the server starts
+	void UpdateSnapshotActor(AActor* Actor, const FActorState& State); // Called whenever the agreed state of an actor changes
+	void RenameSnapshotActor(AActor* Actor, const FName& OldName);
+	void WriteSnapshotHeader(AActor* Actor, TArray<uint8>& OutHeader);
+	void AppendSnapshotActor(const FSnapshotActor& Entry, TArray<uint8>& OutData); // [HEADER][DATASIZE][STATE], as read by DeserializeResync
+
+	// The snapshot is built by capturing actors on the game thread, then encoding them in parallel
+	struct FSnapshotActorCapture
+	{
+		FName ActorName;
+		FMapSyncCapture Header; // Name and class
+		TArray<UCustomSerializer*> Serializers;
+		TArray<FMapSyncCapture> States; // One per serializer
+	};
+	void CaptureSnapshotActor(AActor* Actor, FSnapshotActorCapture& OutCapture);
+	void EncodeSnapshotActor(const FSnapshotActorCapture& Capture, FSnapshotActor& OutEntry); // Thread safe
+
+// Slow clients related stuff, server side
+private:
+	struct FUpdateSummary
+	{
+		bool bCoalescable = true; // Whether the update frame only contains actor updates, for this level
+		TArray<FName> UpdatedActors;
+	};
+	struct FClientSendState
+	{
+		bool bLagging = false; // Whether the client's queue went above ClientQueueHighWater, and didn't drain yet
+		double LaggingSince = 0.0;
+		TSet<FName> CoalescedActors; // Actors whose updates weren't sent while lagging. Only their latest state is sent, once caught up
+	};
+	TMap<int32, FClientSendState> ClientSendStates;
+	int64 ClientQueueHighWater; // In bytes
+	double ClientMaxLagTime; // A client lagging for longer than this, in seconds, has its queue dropped and is resynced
+	void BroadcastUpdate(const TArray<uint8>& Update, int32 ExceptPeerId, const FUpdateSummary& Summary); // Numbers and logs the update, then sends it
+	void TickSlowClients();
+	void SendCoalescedUpdates(int32 ClientId, FClientSendState& State);
+	void RenameCoalescedActor(AActor* Actor, const FName& OldName); // Lagging clients still get the rename, coalesced updates must follow it
 
 // Change handling related stuff
 private:
 	bool bActorInit; // Wether the actor list was initialized
-	TArray<TPair<AActor*, FString>> LastActorsNames; // Actors names stored by actors, used to detect names changes. TODO: replace by TMap, for easier searching?
-	TArray<TPair<AActor*, TArray<uint8>>> LastActorsData; // Last actor send data, to don't send the same update twice
+	TMap<TWeakObjectPtr<AActor>, FName> LastActorsNames; // Actors names stored by actors, used to detect created actors and names changes. Lookups by name go through ActorsByName
+	typedef TArray<TArray<uint8>> FActorState; // An actor state, as written by MapSyncSerialize, one entry per serializer applying to the actor
+	TMap<TWeakObjectPtr<AActor>, FActorState> LastActorsData; // Last actor state every peer agreed on, sent or received. Updates are deltas against it
 	void BuildLastActorsNames();
+	TMap<FName, TWeakObjectPtr<UClass>> ResolvedClasses; // Class path -> class, for actors created by peers
+	void SerializeActorClass(AActor* Actor, FMemoryWriter& Ar); // [CREATEFLAG][CLASSPATH]
+	UClass* ResolveActorClass(char CreateFlag, const FName& ClassPath);
+	AActor* SpawnSyncedActor(const FName& ActorName, char CreateFlag, const FName& ClassPath);
 	TArray<UCustomSerializer*> CustomSerializers;
 	void BuildCustomSerializers();
+	TMap<TWeakObjectPtr<UClass>, TArray<UCustomSerializer*>> SerializerChains; // Serializers applying to each actor class, built on first use. Used to both send and receive
+	const TArray<UCustomSerializer*>& GetActorSerializers(AActor* Actor); // At most MAX_ACTOR_SERIALIZERS, in CustomSerializers order
+	TArray<FDelegateHandle> SerializerDelegateHandles;
+	void BindSerializerDelegates();
+	void UnbindSerializerDelegates();
+	void OnClassesChanged(); // Rebuilds CustomSerializers, and forgets every chain and resolved class
+	void OnCompiledInUObjectsRegistered(FName Package);
+	void OnHotReload(bool bWasTriggeredAutomatically);
+	void CaptureActorState(AActor* Actor, FActorState& OutState);
 
-	bool SerializeAllActorsChange(FMemoryWriter& Ar); // Function which will compute and send all actor changes	
+	// Dirty set, filled by editor delegates, so that only actors that actually changed get serialized each tick
+	TSet<TWeakObjectPtr<AActor>> DirtyActors; // Actors that were created, modified or renamed since last tick
+	TSet<TWeakObjectPtr<AActor>> MovingActors; // Actors being dragged by a gizmo, dirty on every tick until the drag ends
+	float DragSendInterval; // Dragged actors are sent at most this often, in seconds. Grows while peers can't keep up
+	double LastDragSendTime;
+	void UpdateDragSendInterval();
+	TMap<TWeakObjectPtr<AActor>, FTransform> DragSentTransforms; // Transforms of the dragged actors when they were last sent
+	float GetDragChangeRate(float Elapsed) const; // How fast the dragged actors changed since they were last sent, per second. 0 when they didn't
+	TArray<FName> PendingRemovedActors; // Names of synced actors deleted since last tick
+	bool bApplyingRemoteChanges; // Set while applying received data, so that we don't send back what we just received
+	TArray<FDelegateHandle> ChangeDelegateHandles;
+	void BindChangeDelegates();
+	void UnbindChangeDelegates();
+	bool ShouldSyncActor(AActor* Actor) const;
+	void MarkActorDirty(AActor* Actor);
+	void OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& PropertyChangedEvent);
+	void OnObjectTransacted(UObject* Object, const FTransactionObjectEvent& TransactionEvent);
+	void OnActorMoved(AActor* Actor);
+	void OnActorLabelChanged(AActor* Actor);
+	void OnLevelActorAdded(AActor* Actor);
+	void OnLevelActorDeleted(AActor* Actor);
+	void OnBeginObjectMovement(UObject& Object);
+	void OnEndObjectMovement(UObject& Object);
+
+	bool SerializeAllActorsChange(FMemoryWriter& Ar, FUpdateSummary* OutSummary = nullptr); // Function which will compute and send all actor changes	
 	void SerializeOneActorMod(AActor* TheActor, FMemoryWriter& Ar);
-	void DeserializeAllActorsChange(FMemoryReader& Ar); // Called directly when a string is received
+	void SerializeActorDelta(AActor* TheActor, const FActorState& State, const FActorState* LastState, FMemoryWriter& Ar); // [SERIALIZERMASK]([SERIALIZER DELTA])*
+	void DeserializeActorDelta(AActor* TheActor, FMemoryReader& Ar);
+	bool DeserializeAllActorsChange(FMemoryReader& Ar, FUpdateSummary* OutSummary = nullptr, double EndTime = 0.0); // Returns false if it ran out of time before the end
+	bool DeserializeActorCommands(FMemoryReader& Ar, FUpdateSummary* OutSummary = nullptr, double EndTime = 0.0); // Same, after the level name
+	TSet<TWeakObjectPtr<AActor>> AppliedActors; // Actors changed by the frames received this tick, their agreed state is captured once the changes are applied
+	void FlushRemoteChanges(); // Applies what the frames received this tick changed, once per actor
 
+// Actor lookup related stuff
 private:
-
-	// When receiving data from network, it can contain more than one request
-	// Thus, it's organized to be in packets, in the format [data size][actual data]
-	// ArraysToNetData turns data into something sendable across network, and stackable
-	// NetDataToArrays turns something received from network into a mapsync request
-	void AppendArraysToNetData(TArray<uint8>& InputArray, TArray<uint8>& OutNetData);
-	void NetDataToArrays(TArray<uint8>& NetData, TArray<TArray<uint8>>& OutArrays);
+	TMap<FName, TWeakObjectPtr<AActor>> ActorsByName; // Name -> actor index, used by every receive path instead of iterating the world
+	TWeakObjectPtr<UWorld> IndexedWorld; // The world ActorsByName was built from, and whose delegates we're bound to
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle LevelActorAddedHandle;
+	FDelegateHandle LevelActorDeletedHandle;
+	void BuildActorsByName(); // Fills the index and binds the world delegates keeping it current
+	void ClearActorsByName(); // Empties the index and unbinds the delegates
+	void OnIndexedActorAdded(AActor* Actor);
+	void OnIndexedActorRemoved(AActor* Actor);
+	void OnIndexedActorRenamed(AActor* Actor, const FName& OldName);
+	AActor* FindActorByName(const FName& ActorName); // O(1) lookup, falls back to the level's object hash if the index is stale
 };
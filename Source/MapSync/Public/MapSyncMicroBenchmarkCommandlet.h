@@ -0,0 +1,31 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Engine/Classes/Commandlets/Commandlet.h"
+#include "MapSyncMicroBenchmarkCommandlet.generated.h"
+
+class FMapSyncEdMode;
+
+/*
+ * Micro benchmarks of the serialization and framing hot paths, on fixed sets of actors of a single class, without any socket
+ * For each actor class, gives the time and bytes per actor of SerializeOneActorMod, of every serializer of the class, in full and as a delta, of the unchanged state check, and of framing, compressing and decoding
+ *
+ * UE4Editor-Cmd.exe Project.uproject -run=MapSyncMicroBenchmark [-Actors=10000] [-Passes=10] [-Blueprint=/Game/BP_Actor.BP_Actor_C] [-Output=MicroBench.csv]
+ */
+UCLASS()
+class UMapSyncMicroBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UMapSyncMicroBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Each times its hot path on the actors, all of the same class, and adds a CSV line per result
+	void BenchmarkSerialization(FMapSyncEdMode& Mode, const FString& ActorClassName, const TArray<AActor*>& Actors, int32 Passes, FString& OutCsv);
+	void BenchmarkUnchangedCheck(FMapSyncEdMode& Mode, const FString& ActorClassName, const TArray<AActor*>& Actors, int32 Passes, FString& OutCsv);
+	void BenchmarkFraming(FMapSyncEdMode& Mode, const FString& ActorClassName, const TArray<AActor*>& Actors, int32 Passes, FString& OutCsv);
+};
+
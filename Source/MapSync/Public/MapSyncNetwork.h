@@ -0,0 +1,195 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Core/Public/HAL/Runnable.h"
+#include "Runtime/Core/Public/HAL/RunnableThread.h"
+#include "Runtime/Core/Public/HAL/ThreadSafeBool.h"
+#include "Runtime/Core/Public/HAL/ThreadSafeCounter64.h"
+#include "Runtime/Core/Public/Containers/Queue.h"
+#include "Runtime/Core/Public/Misc/Compression.h"
+#include "Runtime/Networking/Public/Networking.h"
+
+// Sent to the network worker to target every connected peer
+#define MAPSYNC_ALL_PEERS INDEX_NONE
+
+// Frames bigger than this are considered as a corrupted stream
+#define MAPSYNC_MAX_FRAME_SIZE (512 * 1024 * 1024)
+
+// Set in a frame's size when its payload is compressed: [FORMAT][UNCOMPRESSEDSIZE][COMPRESSED PAYLOAD]
+#define MAPSYNC_COMPRESSED_FRAME_FLAG (1 << 30)
+
+// How frames sent to a peer are compressed, as negotiated when connecting
+struct FMapSyncCompressionSettings
+{
+	FName Format = NAME_None; // One of the formats FMapSyncNetworkWorker::IsCompressionFormatSupported accepts, or NAME_None to not compress
+	ECompressionFlags Flags = COMPRESS_NoFlags; // COMPRESS_BiasSpeed or COMPRESS_BiasMemory
+	int32 Threshold = 0; // Frames smaller than this, in bytes, are sent uncompressed
+};
+
+// A frame ready to go on the wire, with its size prefix. Shared, and never modified, by every peer it's sent to
+typedef TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> FMapSyncFramePtr;
+
+class FMapSyncRecorder;
+
+// Per peer counters, shared between the game thread and the network worker
+struct FMapSyncPeerStats
+{
+	FThreadSafeCounter64 QueuedBytes; // Enqueued by the game thread, but not sent by the network worker yet
+	FThreadSafeCounter64 BytesSent;
+	FThreadSafeCounter64 BytesReceived;
+};
+typedef TSharedPtr<FMapSyncPeerStats, ESPMode::ThreadSafe> FMapSyncPeerStatsPtr;
+
+// What happened on the network, as seen by the game thread
+enum class EMapSyncNetEvent : uint8
+{
+	Connected, // A peer connected to this server, or we connected to the server
+	Disconnected, // A peer, or the server we were connected to, disconnected
+	Frame, // A complete frame was received from a peer
+};
+
+// Message from the network worker to the game thread
+struct FMapSyncNetInbound
+{
+	EMapSyncNetEvent Event;
+	int32 PeerId;
+	TArray<uint8> Payload; // The frame, without its size prefix. Only set for EMapSyncNetEvent::Frame
+	FMapSyncPeerStatsPtr Stats; // Only set for EMapSyncNetEvent::Connected
+};
+
+// Message from the game thread to the network worker
+struct FMapSyncNetOutbound
+{
+	int32 PeerId = MAPSYNC_ALL_PEERS; // The peer to send to, or MAPSYNC_ALL_PEERS
+	int32 ExceptPeerId = INDEX_NONE; // When sending to all peers, the peer to skip (usually the one the frame came from), or INDEX_NONE
+	TArray<int32> PeerIds; // When not empty, the peers to send to, instead of PeerId
+	TArray<uint8> Payload; // The frame, without its size prefix, moved from the game thread. May be empty when only closing
+	bool bClose = false; // Close the connection to the peer once the payload was sent
+	bool bDroppable = false; // The frame may be dropped by DropQueued, while still waiting in the peer's queue
+	bool bDropQueued = false; // Drop the droppable frames waiting in the peer's queue
+	bool bSetCompression = false; // Use Compression for the frames sent to the peer after this one
+	FMapSyncCompressionSettings Compression;
+	TArray<int32> CountedPeerIds; // Peers the payload was counted in the QueuedBytes of, when enqueued. Set by the worker
+};
+
+/*
+ * Per connection decoder, turning a TCP byte stream into [int32 size][payload] frames. The size may carry MAPSYNC_COMPRESSED_FRAME_FLAG
+ * Bytes are accumulated across reads, so a frame split across several reads, or several frames coalesced in a single read, are both handled
+ * The buffer is used as a ring: it wraps back to its start whenever it is drained, and the unconsumed tail is moved to the front otherwise, so that frames are always contiguous
+ * Complete frames are handed out as views into the buffer, without any copy. They stay valid until the next call to GetWriteBuffer
+ */
+class FMapSyncFrameDecoder
+{
+public:
+	FMapSyncFrameDecoder();
+
+	// Returns where to receive at least MinSize bytes. CommitWrite must then be called with how many bytes were actually written
+	uint8* GetWriteBuffer(int32 MinSize);
+	void CommitWrite(int32 Size);
+
+	// Returns true and sets OutFrame if a complete frame was received. Sets bOutCorrupted if the stream can't be decoded anymore
+	bool NextFrame(TArrayView<const uint8>& OutFrame, bool& bOutCompressed, bool& bOutCorrupted);
+
+	int32 GetPendingSize() const { return WriteIdx - ReadIdx; } // Bytes received but not decoded yet
+
+private:
+	TArray<uint8> Buffer;
+	int32 ReadIdx; // Where the next frame starts
+	int32 WriteIdx; // Where the next received bytes go
+};
+
+/*
+ * The network worker owns every socket used by MapSync, and runs all socket work on its own thread
+ * The game thread never touches a socket: it dequeues received frames and connection events, and enqueues frames to send
+ * Inbound messages go through a single producer single consumer queue, outbound ones through a multiple producers single consumer queue
+ * When acting as a client, the server is the only peer, and has the id 0
+ * Every frame enqueued for a peer counts in its QueuedBytes until it was actually sent, which lets the game thread throttle big transfers
+ * An accepted peer only receives frames sent to all peers once a frame was sent to it directly, so that its welcome message always comes first
+ * Frames are compressed and decompressed here too, so that the game thread never pays for it
+ * A frame sent to several peers is framed, and compressed, once: every peer's send queue references the same buffer, so fanning out doesn't copy anything
+ */
+class FMapSyncNetworkWorker : public FRunnable
+{
+public:
+	// Creates a worker listening on the given port. Returns nullptr if the port couldn't be bound
+	static TUniquePtr<FMapSyncNetworkWorker> Listen(int32 Port);
+	// Creates a worker connected to the given server. Returns nullptr if the server couldn't be reached
+	static TUniquePtr<FMapSyncNetworkWorker> Connect(const FIPv4Endpoint& ServerEndpoint);
+
+	virtual ~FMapSyncNetworkWorker(); // Flushes what's left to send, closes every socket and joins the thread
+
+	// Game thread interface
+	void Send(int32 PeerId, TArray<uint8>&& Payload, int32 ExceptPeerId = INDEX_NONE, bool bDroppable = false);
+	void Multicast(const TArray<int32>& PeerIds, TArray<uint8>&& Payload, bool bDroppable = false); // Sends the same frame to several, but not all, peers
+	void Close(int32 PeerId); // Closes the connection once everything already sent to it went out
+	void DropQueued(int32 PeerId); // Drops the droppable frames not sent yet, for a peer that can't keep up
+	void SetCompression(int32 PeerId, const FMapSyncCompressionSettings& Compression); // Applies to frames sent after this call
+	bool Dequeue(FMapSyncNetInbound& OutInbound);
+	bool HasInbound() const; // Whether something was received, and not dequeued yet
+	int64 GetQueuedBytes(int32 PeerId); // Bytes enqueued for the peer but not sent yet
+	void SetRecorder(FMapSyncRecorder* InRecorder) { Recorder = InRecorder; } // Records what is dequeued and enqueued from now on, nullptr stops. Not owned
+
+	// FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+	// When receiving data from network, it can contain more than one request
+	// Thus, it's organized to be in packets, in the format [data size][actual data]
+	// ArraysToNetData turns data into something sendable across network, and stackable
+	// Received data is turned back into mapsync requests by each peer's FMapSyncFrameDecoder
+	static void AppendArraysToNetData(const TArray<uint8>& InputArray, TArray<uint8>& OutNetData);
+	// Same, but compressed. Returns false, without appending anything, if compressing doesn't make the frame smaller
+	static bool AppendCompressedArraysToNetData(const TArray<uint8>& InputArray, const FMapSyncCompressionSettings& Compression, TArray<uint8>& OutNetData);
+	static bool DecompressFrame(const TArrayView<const uint8>& Frame, TArray<uint8>& OutPayload); // Returns false if the frame is corrupted
+
+	static bool IsCompressionFormatSupported(FName Format);
+
+private:
+	struct FPeer
+	{
+		int32 Id;
+		FSocket* Socket;
+		FMapSyncPeerStatsPtr Stats;
+		struct FQueuedFrame
+		{
+			FMapSyncFramePtr Frame;
+			bool bDroppable;
+		};
+
+		TArray<FQueuedFrame> SendQueue; // Frames waiting to be sent
+		int32 SendQueueHead; // Index in SendQueue of the first frame not fully sent yet
+		int32 SendOffset; // How much of that frame was already sent, when a send was partial
+		FMapSyncFrameDecoder Decoder; // Received data waiting to make complete frames
+		bool bCloseWhenSent;
+		bool bClosed;
+		bool bJoinedBroadcasts; // Whether frames sent to all peers are sent to this one
+		FMapSyncCompressionSettings Compression;
+	};
+
+	FMapSyncNetworkWorker(FSocket* InListenSocket, FSocket* InServerSocket);
+	void StartThread();
+
+	int32 AddPeer(FSocket* Socket, bool bJoinBroadcasts);
+	void Enqueue(FMapSyncNetOutbound&& Outbound); // Counts the frame in the targeted peers' QueuedBytes, then hands it to the worker
+	static bool IsTarget(const FMapSyncNetOutbound& Outbound, int32 PeerId);
+	void ProcessOutbound(FMapSyncNetOutbound& Outbound);
+	void DropQueuedFrames(FPeer& Peer);
+	bool FlushPeer(FPeer& Peer); // Sends as much of the peer's send buffer as the socket accepts without blocking. Returns true if some data was sent
+	bool ReceiveFromPeer(FPeer& Peer); // Returns true if some data was received
+	void ClosePeer(FPeer& Peer);
+	void PushInbound(EMapSyncNetEvent Event, int32 PeerId, TArray<uint8>&& Payload = TArray<uint8>());
+
+	FSocket* ListenSocket; // Only set when acting as a server
+	TArray<FPeer> Peers; // Only accessed from the worker thread
+	int32 NextPeerId;
+	TMap<int32, FMapSyncPeerStatsPtr> PeersStats; // Accessed from both threads, under PeersStatsLock
+	FCriticalSection PeersStatsLock;
+
+	TQueue<FMapSyncNetInbound, EQueueMode::Spsc> InboundQueue;
+	TQueue<FMapSyncNetOutbound, EQueueMode::Mpsc> OutboundQueue;
+	FEvent* WorkEvent; // Wakes the worker up when something was enqueued
+	FThreadSafeBool bStopping;
+	FRunnableThread* Thread;
+	FMapSyncRecorder* Recorder; // Only accessed from the game thread
+};
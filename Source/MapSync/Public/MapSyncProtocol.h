@@ -0,0 +1,100 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Core/Public/Serialization/MemoryWriter.h"
+#include "Runtime/Core/Public/Serialization/MemoryReader.h"
+#include "Runtime/Core/Public/Misc/ScopeRWLock.h"
+
+/*
+ * Strings shared by everyone in a session (actor names, class paths, asset paths, level names)
+ * A string is sent once, in a STRINGS_HEADER frame, and is then referenced by its id, i.e. two varints: [SENDERID][INDEX]
+ * Every sender (the server is 0, clients are given theirs by the server when connecting) allocates indices in its own namespace, so ids never collide
+ * The table is append only for the whole session, so an id stays valid in every frame, including cached or logged ones
+ * It is thread safe, so that frames can be encoded on worker threads
+ */
+class FMapSyncStringTable
+{
+public:
+	FMapSyncStringTable();
+
+	void Reset(uint32 InLocalSenderId); // Forgets every string, and starts allocating in the given namespace
+	void SetLocalSenderId(uint32 InLocalSenderId) { LocalSenderId = InLocalSenderId; }
+	uint32 GetLocalSenderId() const { return LocalSenderId; }
+
+	// Returns the id of the string, allocating it if it's not known yet. New strings are pending until TakePendingStrings is called
+	uint64 Intern(const FName& Name);
+	// Adds a string received from a peer. Defining a known string again is harmless
+	void Define(uint64 Id, const FName& Name);
+	// Returns the string with this id, or NAME_None if it's unknown
+	FName Resolve(uint64 Id) const;
+
+	// Writes, or reads and defines, a list of strings: [COUNT]([SENDERID][INDEX][STRING])*
+	void SerializeStrings(FArchive& Ar, const TArray<uint64>& Ids);
+	void DeserializeStrings(FArchive& Ar);
+	bool HasPendingStrings() const;
+	void TakePendingStrings(TArray<uint64>& OutIds); // Strings allocated since the last call, that peers don't know yet
+	void GetAllStrings(TArray<uint64>& OutIds) const;
+
+	static void SerializeId(FArchive& Ar, uint64& Id);
+
+private:
+	TMap<FName, uint64> Ids;
+	TMap<uint64, FName> Names;
+	TArray<uint64> PendingIds;
+	uint32 LocalSenderId;
+	uint32 NextIndex;
+	mutable FRWLock Lock;
+};
+
+// Memory writer writing FNames as string table ids
+class FMapSyncWriter : public FMemoryWriter
+{
+public:
+	FMapSyncWriter(TArray<uint8>& InBytes, FMapSyncStringTable& InStringTable);
+
+	using FMemoryWriter::operator<<;
+	virtual FArchive& operator<<(FName& Value) override;
+
+private:
+	FMapSyncStringTable& StringTable;
+};
+
+/*
+ * Plain data read from an object on the game thread, that can then be encoded on any thread
+ * Bytes are already encoded, except for FNames: they're only given their string table id when encoding
+ */
+struct FMapSyncCapture
+{
+	TArray<uint8> Bytes;
+	TArray<TPair<int32, FName>> Names; // Where each FName goes in Bytes
+
+	void Encode(FArchive& Ar) const; // Writes Bytes, with the ids of the names in between. Ar should be a FMapSyncWriter
+	int32 GetEncodedSizeEstimate() const { return Bytes.Num() + Names.Num() * 2; }
+};
+
+// Memory writer setting FNames aside in a capture, to be encoded later
+class FMapSyncCaptureWriter : public FMemoryWriter
+{
+public:
+	FMapSyncCaptureWriter(FMapSyncCapture& InCapture);
+
+	using FMemoryWriter::operator<<;
+	virtual FArchive& operator<<(FName& Value) override;
+
+private:
+	FMapSyncCapture& Capture;
+};
+
+// Memory reader reading FNames from string table ids
+class FMapSyncReader : public FMemoryReader
+{
+public:
+	FMapSyncReader(const TArray<uint8>& InBytes, FMapSyncStringTable& InStringTable);
+
+	using FMemoryReader::operator<<;
+	virtual FArchive& operator<<(FName& Value) override;
+
+private:
+	FMapSyncStringTable& StringTable;
+};
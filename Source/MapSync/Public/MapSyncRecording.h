@@ -0,0 +1,80 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Core/Public/Templates/UniquePtr.h"
+#include "MapSyncNetwork.h"
+
+#define MAPSYNC_RECORDING_MAGIC 0x4D535243 // Starts every recording file
+#define MAPSYNC_RECORDING_VERSION 1 // Of the file format, the frames themselves follow the protocol version stored in the file
+
+class FArchive;
+
+// What a record is about
+enum class EMapSyncRecordKind : uint8
+{
+	Connected, // A client connected to the server
+	Disconnected, // A client disconnected
+	Received, // The server received a frame from a client
+	Sent, // The server sent a frame, to a client or to several of them
+};
+
+struct FMapSyncRecord
+{
+	EMapSyncRecordKind Kind = EMapSyncRecordKind::Received;
+	double Time = 0.0; // Seconds since the recording started
+	int32 PeerId = INDEX_NONE; // Network worker peer id, MAPSYNC_ALL_PEERS for frames sent to several clients
+	TArray<uint8> Payload; // The frame, without its size prefix. Only set for Received and Sent records
+};
+
+/*
+ * Writes every network event the server's game thread sees to an append-only file, so that the session can be replayed later
+ * The file is [MAGIC][VERSION][PROTOCOLVERSION][MAPNAME], then records: [KIND][TIMEDELTA][PEERID], and [PAYLOADSIZE][PAYLOAD] for frames
+ * TIMEDELTA is in microseconds since the previous record, PEERID is offset by one so that MAPSYNC_ALL_PEERS is 0. Both are packed, like the payload size
+ * Frames are recorded uncompressed, as the game thread sees them: received ones when dequeued, sent ones when enqueued
+ */
+class FMapSyncRecorder
+{
+public:
+	// Creates the file. Returns nullptr if it couldn't be created
+	static TUniquePtr<FMapSyncRecorder> Create(const FString& Filename, int32 ProtocolVersion, const FString& MapName);
+	~FMapSyncRecorder(); // Flushes and closes the file
+
+	// Game thread only
+	void RecordInbound(const FMapSyncNetInbound& Inbound);
+	void RecordOutbound(const FMapSyncNetOutbound& Outbound);
+
+	const FString& GetFilename() const { return Filename; }
+
+private:
+	FMapSyncRecorder(FArchive* InWriter, const FString& InFilename);
+	void Record(EMapSyncRecordKind Kind, int32 PeerId, const TArray<uint8>* Payload);
+
+	TUniquePtr<FArchive> Writer;
+	FString Filename;
+	double StartTime;
+	uint64 LastRecordMicros; // Time of the last record, since StartTime
+};
+
+// Reads a recording back, one record at a time
+class FMapSyncRecordingReader
+{
+public:
+	// Opens the file and reads its header. Returns nullptr if it isn't a recording, or has another format version
+	static TUniquePtr<FMapSyncRecordingReader> Open(const FString& Filename);
+	~FMapSyncRecordingReader();
+
+	// Returns false at the end of the file. A truncated last record, as left by an editor that crashed while recording, counts as the end
+	bool Next(FMapSyncRecord& OutRecord);
+
+	int32 GetProtocolVersion() const { return ProtocolVersion; }
+	const FString& GetMapName() const { return MapName; } // Long package name of the level the session was recorded on
+
+private:
+	FMapSyncRecordingReader(FArchive* InReader);
+
+	TUniquePtr<FArchive> Reader;
+	int32 ProtocolVersion;
+	FString MapName;
+	uint64 LastRecordMicros;
+};
@@ -0,0 +1,25 @@
+// Copyright 2018, Baptiste Hutteau. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Engine/Classes/Commandlets/Commandlet.h"
+#include "MapSyncReplayCommandlet.generated.h"
+
+/*
+ * Replays a session a MapSync server recorded (see RecordSession in MapSync.ini) into a headless server, as a repeatable benchmark on real traffic
+ * Loads the level the session was recorded on, which must be as it was when the recording started, then plays every recorded client with a loopback client
+ * Clients connect, send their frames and leave at their recorded times, divided by Speed. A speed of 0 replays as fast as the server takes it. Handshakes and pings are left to the loopback clients
+ * Whatever the speed, a frame reaches the server before the next one is sent, so that the server gets them in the recorded order
+ * Writes server tick times, with the serialize and apply parts, bytes on the wire next to the recorded ones, update acknowledgement latency percentiles and how much memory use grew to a CSV
+ *
+ * UE4Editor-Cmd.exe Project.uproject -run=MapSyncReplay -Recording=Session.mapsyncrec [-Speed=1] [-Map=/Game/Maps/Level] [-Port=8990] [-Output=Replay.csv]
+ */
+UCLASS()
+class UMapSyncReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UMapSyncReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};